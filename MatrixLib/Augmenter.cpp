@@ -0,0 +1,307 @@
+#include "Augmenter.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Random.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUGMENTER_SSE
+#endif
+
+const float PI = 3.14159265358979f;
+// Random values drawn for the affine transform and the thickness, a whole Philox block
+const int transformParameters = 8;
+
+Augmenter::Augmenter(const AugmentationParams& params, unsigned int seed) : params(params), seed(seed) {
+	// Without the elastic distortion the blur isn't used, so its sigma doesn't matter
+	if (params.elasticAlpha == 0)
+		return;
+	if (!(params.elasticSigma > 0))
+		throw "Elastic sigma must be positive when elastic alpha isn't zero";
+
+	int radius = static_cast<int>(std::ceil(params.elasticSigma * 3));
+	float sum = 0;
+
+	for (int i = -radius; i <= radius; i++) {
+		float weight = std::exp(-(i * i) / (2 * params.elasticSigma * params.elasticSigma));
+		gaussianKernel.push_back(weight);
+		sum += weight;
+	}
+
+	for (std::size_t i = 0; i < gaussianKernel.size(); i++)
+		gaussianKernel[i] /= sum;
+}
+
+void Augmenter::Apply(const Matrix& batch, Matrix* out, unsigned long long batchIndex) const {
+	PROFILE_SCOPE("Augmenter::Apply");
+
+	if (batch.shape.GetDimentionsCount() != 3)
+		throw "Batch must have {count, height, width} shape";
+	if (batch.shape != out->shape)
+		throw "Operands doesn't have same shapes";
+
+	int count = batch.shape.dimensionSizes[0];
+	int height = batch.shape.dimensionSizes[1];
+	int width = batch.shape.dimensionSizes[2];
+	unsigned long long firstImage = batchIndex * count;
+
+	ThreadPool::Instance().ParallelFor(count, [&](int from, int to) {
+		augmentRange(batch.data, out->data, from, to, height, width, firstImage);
+	});
+}
+
+void Augmenter::augmentRange(const float* in, float* out, int from, int to, int height, int width, unsigned long long firstImage) const {
+	int size = height * width;
+	int radius = static_cast<int>(gaussianKernel.size() / 2);
+	// dx, dy, sampled image and a buffer shared by the blur and the thickness passes
+	std::vector<float> scratch(3 * size + std::max(size + width + 2 * radius, (height + 2) * (width + 2)));
+
+	for (int i = from; i < to; i++)
+		augmentImage(in + i * size, out + i * size, height, width, firstImage + i, scratch.data());
+}
+
+void Augmenter::augmentImage(const float* in, float* out, int height, int width, unsigned long long imageIndex, float* scratch) const {
+	int size = height * width;
+	float* dx = scratch;
+	float* dy = scratch + size;
+	float* sampled = scratch + 2 * size;
+	float* buffer = scratch + 3 * size;
+
+	// Every image is its own stream: transform parameters first, then the displacement field and the noise
+	Random generator(seed, imageIndex);
+	float parameters[transformParameters];
+	generator.Uniform(parameters, 0, transformParameters, -1.0f, 1.0f);
+
+	float angle = parameters[0] * params.maxRotation * PI / 180;
+	float scaleX = 1 + parameters[1] * params.maxScale;
+	float scaleY = 1 + parameters[2] * params.maxScale;
+	float shear = parameters[3] * params.maxShear;
+	float shiftX = parameters[4] * params.maxTranslation;
+	float shiftY = parameters[5] * params.maxTranslation;
+	int thickness = static_cast<int>(std::lround(parameters[6] * params.maxThickness));
+
+	std::vector<float> random(2 * size);
+	generator.Uniform(random.data(), transformParameters, 2 * size, -1.0f, 1.0f);
+
+	std::vector<float> noise(params.noiseStddev > 0 ? size : 0);
+	generator.Normal(noise.data(), transformParameters + 2 * size, static_cast<int>(noise.size()), 0.0f, params.noiseStddev);
+
+	// Forward transform is rotation * shear * scale around the image center, sampling needs the inverse one
+	float cosA = std::cos(angle), sinA = std::sin(angle);
+	float m00 = cosA * scaleX, m01 = (cosA * shear - sinA) * scaleY;
+	float m10 = sinA * scaleX, m11 = (sinA * shear + cosA) * scaleY;
+	float det = m00 * m11 - m01 * m10;
+
+	float centerX = (width - 1) * 0.5f;
+	float centerY = (height - 1) * 0.5f;
+	float a = m11 / det, b = -m01 / det;
+	float d = -m10 / det, e = m00 / det;
+	float transform[6] = {
+		a, b, centerX - a * (centerX + shiftX) - b * (centerY + shiftY),
+		d, e, centerY - d * (centerX + shiftX) - e * (centerY + shiftY)
+	};
+
+	createDisplacementField(dx, dy, buffer, height, width, random);
+	sample(in, sampled, dx, dy, transform, height, width);
+
+	if (thickness != 0)
+		changeThickness(sampled, buffer, height, width, thickness);
+
+	if (!noise.empty())
+		addNoise(sampled, size, noise);
+
+	std::copy(sampled, sampled + size, out);
+}
+
+void Augmenter::createDisplacementField(float* dx, float* dy, float* scratch, int height, int width, std::vector<float>& random) const {
+	int size = height * width;
+
+	if (params.elasticAlpha == 0) {
+		std::fill(dx, dx + size, 0.0f);
+		std::fill(dy, dy + size, 0.0f);
+		return;
+	}
+
+	std::copy(random.begin(), random.begin() + size, dx);
+	std::copy(random.begin() + size, random.end(), dy);
+	blur(dx, scratch, height, width);
+	blur(dy, scratch, height, width);
+
+	for (int i = 0; i < size; i++) {
+		dx[i] *= params.elasticAlpha;
+		dy[i] *= params.elasticAlpha;
+	}
+}
+
+// Separable gaussian blur with zero padding, scratch must fit height * width + width + 2 * radius floats
+void Augmenter::blur(float* data, float* scratch, int height, int width) const {
+	int radius = static_cast<int>(gaussianKernel.size() / 2);
+	int taps = static_cast<int>(gaussianKernel.size());
+	float* horizontal = scratch;
+	float* row = scratch + height * width;
+
+	std::fill(row, row + width + 2 * radius, 0.0f);
+
+	for (int y = 0; y < height; y++) {
+		std::copy(data + y * width, data + (y + 1) * width, row + radius);
+		float* target = horizontal + y * width;
+		int x = 0;
+
+#ifdef AUGMENTER_SSE
+		for (; x + 4 <= width; x += 4) {
+			__m128 acc = _mm_setzero_ps();
+			for (int k = 0; k < taps; k++)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(gaussianKernel[k]), _mm_loadu_ps(row + x + k)));
+			_mm_storeu_ps(target + x, acc);
+		}
+#endif
+		for (; x < width; x++) {
+			float acc = 0;
+			for (int k = 0; k < taps; k++)
+				acc += gaussianKernel[k] * row[x + k];
+			target[x] = acc;
+		}
+	}
+
+	for (int y = 0; y < height; y++) {
+		int first = std::max(0, y - radius);
+		int last = std::min(height - 1, y + radius);
+		float* target = data + y * width;
+		int x = 0;
+
+#ifdef AUGMENTER_SSE
+		for (; x + 4 <= width; x += 4) {
+			__m128 acc = _mm_setzero_ps();
+			for (int source = first; source <= last; source++)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(gaussianKernel[source - y + radius]), _mm_loadu_ps(horizontal + source * width + x)));
+			_mm_storeu_ps(target + x, acc);
+		}
+#endif
+		for (; x < width; x++) {
+			float acc = 0;
+			for (int source = first; source <= last; source++)
+				acc += gaussianKernel[source - y + radius] * horizontal[source * width + x];
+			target[x] = acc;
+		}
+	}
+}
+
+// Bilinear sampling of the source at the affine transformed coordinates shifted by the displacement field
+void Augmenter::sample(const float* in, float* out, const float* dx, const float* dy, const float* transform, int height, int width) const {
+	std::vector<float> sourceX(width), sourceY(width);
+
+	for (int y = 0; y < height; y++) {
+		float rowX = transform[1] * y + transform[2];
+		float rowY = transform[4] * y + transform[5];
+		const float* rowDx = dx + y * width;
+		const float* rowDy = dy + y * width;
+		int x = 0;
+
+#ifdef AUGMENTER_SSE
+		__m128 stepX = _mm_set1_ps(transform[0]);
+		__m128 stepY = _mm_set1_ps(transform[3]);
+		for (; x + 4 <= width; x += 4) {
+			__m128 column = _mm_set_ps(x + 3.0f, x + 2.0f, x + 1.0f, static_cast<float>(x));
+			__m128 positionX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column, stepX), _mm_set1_ps(rowX)), _mm_loadu_ps(rowDx + x));
+			__m128 positionY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column, stepY), _mm_set1_ps(rowY)), _mm_loadu_ps(rowDy + x));
+			_mm_storeu_ps(sourceX.data() + x, positionX);
+			_mm_storeu_ps(sourceY.data() + x, positionY);
+		}
+#endif
+		for (; x < width; x++) {
+			sourceX[x] = transform[0] * x + rowX + rowDx[x];
+			sourceY[x] = transform[3] * x + rowY + rowDy[x];
+		}
+
+		for (x = 0; x < width; x++) {
+			float fx = std::floor(sourceX[x]);
+			float fy = std::floor(sourceY[x]);
+			int x0 = static_cast<int>(fx);
+			int y0 = static_cast<int>(fy);
+			float wx = sourceX[x] - fx;
+			float wy = sourceY[x] - fy;
+			float value = 0;
+
+			for (int j = 0; j < 2; j++) {
+				int sy = y0 + j;
+				if (sy < 0 || sy >= height)
+					continue;
+
+				for (int i = 0; i < 2; i++) {
+					int sx = x0 + i;
+					if (sx < 0 || sx >= width)
+						continue;
+
+					value += (i ? wx : 1 - wx) * (j ? wy : 1 - wy) * in[sy * width + sx];
+				}
+			}
+
+			out[y * width + x] = value;
+		}
+	}
+}
+
+// Positive thickness dilates strokes with a 3x3 max filter, negative one erodes them with a min filter
+void Augmenter::changeThickness(float* data, float* scratch, int height, int width, int thickness) const {
+	int paddedWidth = width + 2;
+	bool dilate = thickness > 0;
+
+	for (int pass = 0; pass < std::abs(thickness); pass++) {
+		std::fill(scratch, scratch + (height + 2) * paddedWidth, 0.0f);
+		for (int y = 0; y < height; y++)
+			std::copy(data + y * width, data + (y + 1) * width, scratch + (y + 1) * paddedWidth + 1);
+
+		for (int y = 0; y < height; y++) {
+			const float* top = scratch + y * paddedWidth;
+			const float* middle = top + paddedWidth;
+			const float* bottom = middle + paddedWidth;
+			float* target = data + y * width;
+			int x = 0;
+
+#ifdef AUGMENTER_SSE
+			for (; x + 4 <= width; x += 4) {
+				__m128 result = _mm_loadu_ps(middle + x + 1);
+				for (int k = 0; k < 3; k++) {
+					__m128 column;
+					if (dilate) {
+						column = _mm_max_ps(_mm_max_ps(_mm_loadu_ps(top + x + k), _mm_loadu_ps(middle + x + k)), _mm_loadu_ps(bottom + x + k));
+						result = _mm_max_ps(result, column);
+					}
+					else {
+						column = _mm_min_ps(_mm_min_ps(_mm_loadu_ps(top + x + k), _mm_loadu_ps(middle + x + k)), _mm_loadu_ps(bottom + x + k));
+						result = _mm_min_ps(result, column);
+					}
+				}
+				_mm_storeu_ps(target + x, result);
+			}
+#endif
+			for (; x < width; x++) {
+				float result = middle[x + 1];
+				for (int k = 0; k < 3; k++) {
+					if (dilate)
+						result = std::max(result, std::max(std::max(top[x + k], middle[x + k]), bottom[x + k]));
+					else
+						result = std::min(result, std::min(std::min(top[x + k], middle[x + k]), bottom[x + k]));
+				}
+				target[x] = result;
+			}
+		}
+	}
+}
+
+void Augmenter::addNoise(float* data, int size, const std::vector<float>& noise) const {
+	int i = 0;
+
+#ifdef AUGMENTER_SSE
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= size; i += 4) {
+		__m128 value = _mm_add_ps(_mm_loadu_ps(data + i), _mm_loadu_ps(noise.data() + i));
+		_mm_storeu_ps(data + i, _mm_min_ps(_mm_max_ps(value, zero), one));
+	}
+#endif
+	for (; i < size; i++)
+		data[i] = std::min(std::max(data[i] + noise[i], 0.0f), 1.0f);
+}
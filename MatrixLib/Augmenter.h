@@ -0,0 +1,38 @@
+#pragma once
+#include "Matrix.h"
+#include "Exportable.h"
+#include <vector>
+
+// Ranges of the random transformations, every image of a batch gets its own values drawn from them
+struct STORING_ATTR AugmentationParams {
+	float maxRotation = 12.0f;     // degrees
+	float maxScale = 0.12f;        // relative, applied to each axis independently
+	float maxShear = 0.25f;
+	float maxTranslation = 2.0f;   // pixels
+	float elasticAlpha = 34.0f;    // displacement field intensity
+	float elasticSigma = 4.0f;     // displacement field smoothness, must be positive unless elasticAlpha is 0
+	float noiseStddev = 0.03f;
+	int maxThickness = 1;          // strokes are dilated or eroded by up to this many pixels
+};
+
+class STORING_ATTR Augmenter {
+	AugmentationParams params;
+	unsigned int seed;
+	std::vector<float> gaussianKernel;
+
+public:
+	Augmenter(const AugmentationParams& params, unsigned int seed);
+
+	// Batch must have {count, height, width} shape, out must have the same shape.
+	// The result depends only on the seed, batchIndex and image position in the batch
+	void Apply(const Matrix& batch, Matrix* out, unsigned long long batchIndex) const;
+
+private:
+	void augmentRange(const float* in, float* out, int from, int to, int height, int width, unsigned long long firstImage) const;
+	void augmentImage(const float* in, float* out, int height, int width, unsigned long long imageIndex, float* scratch) const;
+	void createDisplacementField(float* dx, float* dy, float* scratch, int height, int width, std::vector<float>& random) const;
+	void blur(float* data, float* scratch, int height, int width) const;
+	void sample(const float* in, float* out, const float* dx, const float* dy, const float* transform, int height, int width) const;
+	void changeThickness(float* data, float* scratch, int height, int width, int thickness) const;
+	void addNoise(float* data, int size, const std::vector<float>& noise) const;
+};
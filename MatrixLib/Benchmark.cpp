@@ -0,0 +1,202 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+BenchmarkRunner::BenchmarkRunner(const std::string& filter, int warmup, int repetitions, double minimalTimeUs) :
+	filter(filter), warmup(warmup), repetitions(repetitions), minimalTimeUs(minimalTimeUs), failures(0) {}
+
+std::string BenchmarkResult::Key() const {
+	return name + "|" + backend + "|" + shape + "|" + dtype;
+}
+
+void BenchmarkRunner::Add(const BenchmarkCase& benchmark) {
+	std::string fullName = benchmark.name + "/" + benchmark.backend + "/" + benchmark.shape;
+
+	if (filter.empty() || fullName.find(filter) != std::string::npos)
+		cases.push_back(benchmark);
+}
+
+void BenchmarkRunner::Run() {
+	for (const auto& benchmark : cases) {
+		try {
+			if (benchmark.check) {
+				benchmark.run();
+				double error = benchmark.check();
+
+				if (!(error <= benchmark.tolerance)) {
+					std::cerr << "Failed " << benchmark.name << " on " << benchmark.backend << ": relative error " << error << "\n";
+					failures++;
+					continue;
+				}
+			}
+
+			results.push_back(measure(benchmark));
+		}
+		catch (const char* error) {
+			std::cerr << "Skipped " << benchmark.name << " on " << benchmark.backend << ": " << error << "\n";
+		}
+		catch (const std::exception& error) {
+			std::cerr << "Skipped " << benchmark.name << " on " << benchmark.backend << ": " << error.what() << "\n";
+		}
+	}
+}
+
+BenchmarkResult BenchmarkRunner::measure(const BenchmarkCase& benchmark) const {
+	for (int i = 0; i < warmup; i++)
+		benchmark.run();
+
+	std::vector<double> samples;
+	double total = 0;
+
+	// At least the requested repetitions, more for fast cases so the statistics are stable
+	while (static_cast<int>(samples.size()) < repetitions || (total < minimalTimeUs && samples.size() < 10000)) {
+		auto start = std::chrono::steady_clock::now();
+		benchmark.run();
+		auto end = std::chrono::steady_clock::now();
+
+		double us = std::chrono::duration<double, std::micro>(end - start).count();
+		samples.push_back(us);
+		total += us;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	BenchmarkResult result;
+	result.name = benchmark.name;
+	result.backend = benchmark.backend;
+	result.shape = benchmark.shape;
+	result.dtype = benchmark.dtype;
+	result.repetitions = static_cast<int>(samples.size());
+	result.minUs = samples.front();
+	result.meanUs = total / samples.size();
+	result.medianUs = samples[samples.size() / 2];
+	result.p95Us = samples[std::min(samples.size() - 1, samples.size() * 95 / 100)];
+	result.gbPerSecond = benchmark.bytes / (result.medianUs * 1e3);
+	result.gflopsPerSecond = benchmark.flops / (result.medianUs * 1e3);
+	result.baselineMedianUs = 0;
+
+	return result;
+}
+
+void BenchmarkRunner::Print() const {
+	std::printf("%-28s %-12s %-14s %8s %12s %12s %10s %10s %10s\n", "benchmark", "backend", "shape", "reps", "median us", "p95 us", "GB/s", "GFLOP/s", "baseline");
+
+	for (const auto& result : results) {
+		std::string change = "-";
+
+		if (result.baselineMedianUs > 0) {
+			char buffer[32];
+			std::snprintf(buffer, sizeof(buffer), "%+.1f%%", (result.medianUs / result.baselineMedianUs - 1) * 100);
+			change = buffer;
+		}
+
+		std::printf("%-28s %-12s %-14s %8d %12.2f %12.2f %10.3f %10.3f %10s\n", result.name.c_str(), result.backend.c_str(), result.shape.c_str(),
+			result.repetitions, result.medianUs, result.p95Us, result.gbPerSecond, result.gflopsPerSecond, change.c_str());
+	}
+}
+
+void BenchmarkRunner::WriteJson(const std::string& path) const {
+	std::ofstream file(path);
+	if (!file)
+		throw "Can't create benchmark results file";
+
+	file << "{\n  \"benchmarks\": [\n";
+
+	for (std::size_t i = 0; i < results.size(); i++) {
+		const auto& result = results[i];
+
+		file << "    {\"name\": \"" << result.name << "\", \"backend\": \"" << result.backend << "\", \"shape\": \"" << result.shape
+			<< "\", \"dtype\": \"" << result.dtype << "\", \"repetitions\": " << result.repetitions
+			<< ", \"min_us\": " << result.minUs << ", \"mean_us\": " << result.meanUs << ", \"median_us\": " << result.medianUs
+			<< ", \"p95_us\": " << result.p95Us << ", \"gb_per_s\": " << result.gbPerSecond << ", \"gflop_per_s\": " << result.gflopsPerSecond << "}";
+
+		file << (i + 1 == results.size() ? "\n" : ",\n");
+	}
+
+	file << "  ]\n}\n";
+}
+
+std::string extractString(const std::string& object, const std::string& key) {
+	std::size_t position = object.find("\"" + key + "\"");
+	if (position == std::string::npos)
+		return "";
+
+	std::size_t begin = object.find('"', object.find(':', position) + 1);
+	std::size_t end = object.find('"', begin + 1);
+
+	return object.substr(begin + 1, end - begin - 1);
+}
+
+double extractNumber(const std::string& object, const std::string& key) {
+	std::size_t position = object.find("\"" + key + "\"");
+	if (position == std::string::npos)
+		return 0;
+
+	std::istringstream stream(object.substr(object.find(':', position) + 1));
+	double value = 0;
+	stream >> value;
+
+	return value;
+}
+
+// Reads files written by WriteJson, every case is a flat object on its own
+void BenchmarkRunner::readBaseline(const std::string& path, std::vector<BenchmarkResult>* baseline) {
+	std::ifstream file(path);
+	if (!file)
+		throw "Can't open baseline file";
+
+	std::stringstream content;
+	content << file.rdbuf();
+	std::string text = content.str();
+
+	std::size_t begin = text.find('[');
+	while (begin != std::string::npos) {
+		begin = text.find('{', begin);
+		if (begin == std::string::npos)
+			break;
+
+		std::size_t end = text.find('}', begin);
+		std::string object = text.substr(begin, end - begin + 1);
+
+		BenchmarkResult result = BenchmarkResult();
+		result.name = extractString(object, "name");
+		result.backend = extractString(object, "backend");
+		result.shape = extractString(object, "shape");
+		result.dtype = extractString(object, "dtype");
+		result.medianUs = extractNumber(object, "median_us");
+		baseline->push_back(result);
+
+		begin = end;
+	}
+}
+
+int BenchmarkRunner::CompareWithBaseline(const std::string& path, double threshold) {
+	std::vector<BenchmarkResult> baseline;
+	readBaseline(path, &baseline);
+
+	int regressions = 0;
+
+	for (auto& result : results) {
+		for (const auto& previous : baseline) {
+			if (previous.Key() != result.Key() || previous.medianUs <= 0)
+				continue;
+
+			result.baselineMedianUs = previous.medianUs;
+			double ratio = result.medianUs / previous.medianUs;
+
+			if (ratio > 1 + threshold) {
+				std::cerr << "Regression: " << result.Key() << " " << previous.medianUs << "us -> " << result.medianUs << "us\n";
+				regressions++;
+			}
+			else if (ratio < 1 - threshold)
+				std::cerr << "Improvement: " << result.Key() << " " << previous.medianUs << "us -> " << result.medianUs << "us\n";
+		}
+	}
+
+	return regressions;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchmarkCase {
+	std::string name;
+	std::string backend;
+	std::string shape;
+	std::string dtype;
+	// Work done by one run, zero when throughput has no meaning for the case
+	double bytes;
+	double flops;
+	std::function<void()> run;
+	// Optional, largest error of the results left by run against a reference relative to the largest reference
+	// value. Checked once before the measurement, cases above the tolerance fail and aren't measured
+	std::function<double()> check;
+	double tolerance = 1e-3;
+};
+
+struct BenchmarkResult {
+	std::string name;
+	std::string backend;
+	std::string shape;
+	std::string dtype;
+	int repetitions;
+	double minUs;
+	double meanUs;
+	double medianUs;
+	double p95Us;
+	double gbPerSecond;
+	double gflopsPerSecond;
+	// Filled by the baseline comparison, zero when the case isn't in the baseline
+	double baselineMedianUs;
+
+	std::string Key() const;
+};
+
+class BenchmarkRunner {
+	std::vector<BenchmarkCase> cases;
+	std::vector<BenchmarkResult> results;
+	std::string filter;
+	int warmup;
+	int repetitions;
+	double minimalTimeUs;
+	int failures;
+
+public:
+	BenchmarkRunner(const std::string& filter, int warmup, int repetitions, double minimalTimeUs);
+
+	void Add(const BenchmarkCase& benchmark);
+	void Run();
+	inline int Failures() const { return failures; }
+	void Print() const;
+	void WriteJson(const std::string& path) const;
+
+	// Returns number of cases which median got slower than the baseline by more than the threshold
+	int CompareWithBaseline(const std::string& path, double threshold);
+
+private:
+	BenchmarkResult measure(const BenchmarkCase& benchmark) const;
+	static void readBaseline(const std::string& path, std::vector<BenchmarkResult>* baseline);
+};
@@ -0,0 +1,757 @@
+#include "Benchmark.h"
+#include "Matrix.h"
+#include "Context.h"
+#include "Augmenter.h"
+#include "Segmenter.h"
+#include "InferenceEngine.h"
+#include "GraphCompiler.h"
+#include "Profiler.h"
+#include "SimdKernels.h"
+#include "SparseMatrix.h"
+#include "Metrics.h"
+#include "SoftmaxCrossEntropy.h"
+#include "Random.h"
+#include "StreamingExecuter.h"
+#include "DataParallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+struct BackendInfo {
+	Backend backend;
+	const char* name;
+};
+
+const BackendInfo backends[] = {
+	{ Backend::OpenCLCpu, "opencl-cpu" },
+	{ Backend::OpenCLGpu, "opencl-gpu" },
+	{ Backend::Native, "native" }
+};
+
+std::vector<std::unique_ptr<Matrix>> storage;
+
+Matrix& createMatrix(const std::vector<int>& dimensions, bool random) {
+	storage.push_back(std::unique_ptr<Matrix>(new Matrix(Shape(dimensions), random)));
+	return *storage.back();
+}
+
+std::string describeShape(const std::vector<int>& dimensions) {
+	std::string description;
+
+	for (std::size_t i = 0; i < dimensions.size(); i++)
+		description += (i == 0 ? "" : "x") + std::to_string(dimensions[i]);
+
+	return description;
+}
+
+// Largest difference relative to the largest reference value, so values near zero don't dominate
+double relativeError(const float* values, const std::vector<double>& reference) {
+	double largest = 0, error = 0;
+	for (std::size_t i = 0; i < reference.size(); i++) {
+		largest = std::max(largest, std::fabs(reference[i]));
+		error = std::max(error, std::fabs(values[i] - reference[i]));
+	}
+
+	return largest == 0 ? error : error / largest;
+}
+
+// Expressions keep references to their operands, so every case owns its matrices for the whole run
+void addElementwiseCases(BenchmarkRunner& runner, const std::vector<int>& dimensions) {
+	Matrix& a = createMatrix(dimensions, true);
+	Matrix& b = createMatrix(dimensions, true);
+	Matrix& c = createMatrix(dimensions, true);
+	Matrix& result = createMatrix(dimensions, false);
+	double size = a.shape.size;
+
+	struct Chain {
+		const char* name;
+		const Operand* expression;
+		int inputs;
+		int flops;
+	};
+
+	Chain chains[] = {
+		{ "elementwise/add", &(a + b), 2, 1 },
+		{ "elementwise/mul-add", &(a * b + c), 3, 2 },
+		{ "elementwise/chain-4", &((a * b + c - a) / b), 3, 4 },
+		{ "elementwise/scalar-3", &((a * 0.5f + 1.0f) / 3.0f), 1, 3 },
+		{ "reduction/sum-broadcast", &(a.Sum() + b), 2, 2 }
+	};
+
+	for (const auto& chain : chains) {
+		for (const auto& backend : backends) {
+			BenchmarkCase benchmark;
+			benchmark.name = chain.name;
+			benchmark.backend = backend.name;
+			benchmark.shape = describeShape(dimensions);
+			benchmark.dtype = "float32";
+			benchmark.bytes = sizeof(float) * size * (chain.inputs + 1);
+			benchmark.flops = size * chain.flops;
+
+			const Operand* expression = chain.expression;
+			Backend selected = backend.backend;
+			benchmark.run = [expression, &result, selected]() { expression->AssignTo(&result, selected); };
+			runner.Add(benchmark);
+		}
+	}
+}
+
+// Targets read by their own expression, checked against the values before the run. Shifted reads elements of
+// the target which other tiles write
+void addAliasingCases(BenchmarkRunner& runner) {
+	std::vector<int> dimensions{ 256, 256 };
+	const int size = 256 * 256;
+	Matrix& source = createMatrix({ size + 1 }, true);
+	Matrix& buffer = createMatrix({ size + 1 }, false);
+	storage.push_back(std::unique_ptr<Matrix>(new Matrix(Shape(dimensions), buffer.data, false)));
+	Matrix& x = *storage.back();
+	storage.push_back(std::unique_ptr<Matrix>(new Matrix(Shape(dimensions), buffer.data + 1, false)));
+	Matrix& shifted = *storage.back();
+
+	struct Alias {
+		const char* name;
+		const Operand* expression;
+		Matrix* target;
+		std::function<double(const float* values, int i)> reference;
+	};
+
+	Alias aliases[] = {
+		{ "aliasing/in-place-left", &(x * x + x), &x, [](const float* values, int i) { return static_cast<double>(values[i]) * values[i] + values[i]; } },
+		{ "aliasing/in-place-right", &((x + 1.0f) * x), &x, [](const float* values, int i) { return (values[i] + 1.0) * values[i]; } },
+		{ "aliasing/shifted", &(x * 2.0f + shifted), &shifted, [](const float* values, int i) { return 2.0 * values[i] + values[i + 1]; } }
+	};
+
+	for (const auto& alias : aliases) {
+		auto reference = std::make_shared<std::vector<double>>(size);
+		for (int i = 0; i < size; i++)
+			(*reference)[i] = alias.reference(source.data, i);
+
+		for (const auto& info : backends) {
+			BenchmarkCase benchmark;
+			benchmark.name = alias.name;
+			benchmark.backend = info.name;
+			benchmark.shape = describeShape(dimensions);
+			benchmark.dtype = "float32";
+			benchmark.bytes = 3.0 * sizeof(float) * size;
+			benchmark.flops = 2.0 * size;
+
+			const Operand* expression = alias.expression;
+			Matrix* target = alias.target;
+			Backend backend = info.backend;
+			benchmark.run = [&source, &buffer, expression, target, backend]() {
+				std::memcpy(buffer.data, source.data, sizeof(float) * source.shape.size);
+				expression->AssignTo(target, backend);
+			};
+			benchmark.check = [target, reference]() { return relativeError(target->data, *reference); };
+			runner.Add(benchmark);
+		}
+	}
+}
+
+void addCodegenCase(BenchmarkRunner& runner, const std::vector<int>& dimensions) {
+	Matrix& a = createMatrix(dimensions, false);
+	Matrix& b = createMatrix(dimensions, false);
+	Matrix& c = createMatrix(dimensions, false);
+	Matrix& result = createMatrix(dimensions, false);
+	// Sums launch their kernel while being evaluated, so the chain is generated without one
+	const Operand* expression = &((a * b + c - a) / b);
+
+	BenchmarkCase benchmark;
+	benchmark.name = "codegen/chain-4";
+	benchmark.backend = "host";
+	benchmark.shape = describeShape(dimensions);
+	benchmark.dtype = "float32";
+	benchmark.bytes = 0;
+	benchmark.flops = 0;
+	benchmark.run = [expression, &result]() {
+		std::string source;
+		std::vector<Operand*> operands;
+		Context context;
+
+		result.Evaluate(context, operands);
+		expression->Evaluate(context, operands);
+		context.GenerateFile(&source);
+	};
+	runner.Add(benchmark);
+}
+
+void addPreprocessingCases(BenchmarkRunner& runner) {
+	std::vector<int> batchDimensions{ 128, 28, 28 };
+	Matrix& batch = createMatrix(batchDimensions, false);
+	Matrix& augmented = createMatrix(batchDimensions, false);
+
+	for (int i = 0; i < batch.shape.size; i++)
+		batch.data[i] = (i % 28 > 10 && i % 28 < 16) ? 1.0f : 0.0f;
+
+	auto augmenter = std::make_shared<Augmenter>(AugmentationParams(), 1);
+	unsigned long long batchIndex = 0;
+
+	BenchmarkCase augmentation;
+	augmentation.name = "preprocessing/augment";
+	augmentation.backend = "native";
+	augmentation.shape = describeShape(batchDimensions);
+	augmentation.dtype = "float32";
+	augmentation.bytes = 2.0 * sizeof(float) * batch.shape.size;
+	augmentation.flops = 0;
+	augmentation.run = [augmenter, &batch, &augmented, batchIndex]() mutable { augmenter->Apply(batch, &augmented, batchIndex++); };
+	runner.Add(augmentation);
+
+	// A line of vertical strokes imitating a drawn number
+	std::vector<int> imageDimensions{ 200, 1600 };
+	Matrix& image = createMatrix(imageDimensions, false);
+
+	for (int y = 40; y < 160; y++)
+		for (int x = 0; x < 1600; x++)
+			image.data[y * 1600 + x] = (x % 80 > 30 && x % 80 < 42) ? 1.0f : 0.0f;
+
+	auto segmenter = std::make_shared<Segmenter>();
+
+	BenchmarkCase segmentation;
+	segmentation.name = "preprocessing/segment";
+	segmentation.backend = "native";
+	segmentation.shape = describeShape(imageDimensions);
+	segmentation.dtype = "float32";
+	segmentation.bytes = sizeof(float) * image.shape.size;
+	segmentation.flops = 0;
+	segmentation.run = [segmenter, &image]() { delete segmenter->Process(image, nullptr); };
+	runner.Add(segmentation);
+}
+
+// Kernels are run directly for every instruction set level the CPU supports, backend column holds the level
+void addSimdCases(BenchmarkRunner& runner) {
+	const int size = 256;
+	Matrix& a = createMatrix({ size, size }, true);
+	Matrix& b = createMatrix({ size, size }, true);
+	Matrix& c = createMatrix({ size, size }, false);
+
+	std::vector<int> vectorDimensions{ 1 << 20 };
+	Matrix& input = createMatrix(vectorDimensions, true);
+	Matrix& output = createMatrix(vectorDimensions, false);
+
+	for (int level = 0; level <= static_cast<int>(CpuFeatures::Detect()); level++) {
+		const KernelTable* kernels = &KernelsFor(static_cast<IsaLevel>(level));
+
+		BenchmarkCase gemm;
+		gemm.name = "simd/gemm";
+		gemm.backend = CpuFeatures::Name(kernels->level);
+		gemm.shape = describeShape({ size, size, size });
+		gemm.dtype = "float32";
+		gemm.bytes = 3.0 * sizeof(float) * size * size;
+		gemm.flops = 2.0 * size * size * size;
+		gemm.run = [kernels, &a, &b, &c, size]() {
+			c.Fill(0);
+			kernels->gemm(size, size, size, a.data, size, b.data, size, c.data, size);
+		};
+		runner.Add(gemm);
+
+		BenchmarkCase sigmoid;
+		sigmoid.name = "simd/sigmoid";
+		sigmoid.backend = CpuFeatures::Name(kernels->level);
+		sigmoid.shape = describeShape(vectorDimensions);
+		sigmoid.dtype = "float32";
+		sigmoid.bytes = 2.0 * sizeof(float) * input.shape.size;
+		sigmoid.flops = 0;
+		sigmoid.run = [kernels, &input, &output]() { kernels->sigmoid(input.data, output.data, input.shape.size); };
+		runner.Add(sigmoid);
+	}
+}
+
+// Double precision forward pass of fully connected layers, weights are {outputs, inputs}
+std::vector<double> referenceForward(const std::vector<ModelLayer>& layers, const Matrix& input) {
+	int batch = input.shape.dimensionSizes[0];
+	std::vector<double> values(input.data, input.data + input.shape.size);
+
+	for (const ModelLayer& layer : layers) {
+		int outputs = layer.weights->shape.dimensionSizes[0];
+		int inputs = layer.weights->shape.dimensionSizes[1];
+		std::vector<double> next(static_cast<std::size_t>(batch) * outputs);
+
+		for (int row = 0; row < batch; row++) {
+			for (int output = 0; output < outputs; output++) {
+				double value = layer.biases->data[output];
+				for (int i = 0; i < inputs; i++)
+					value += static_cast<double>(layer.weights->data[output * inputs + i]) * values[static_cast<std::size_t>(row) * inputs + i];
+
+				if (layer.activation == Activation::Sigmoid)
+					value = 1 / (1 + std::exp(-value));
+				else if (layer.activation == Activation::ReLU)
+					value = std::max(value, 0.0);
+				else if (layer.activation == Activation::Tanh)
+					value = std::tanh(value);
+
+				next[static_cast<std::size_t>(row) * outputs + output] = value;
+			}
+		}
+
+		values.swap(next);
+	}
+
+	return values;
+}
+
+// Requests are submitted without waiting like from many clients, engines differ only by the maximal batch size
+void addInferenceCases(BenchmarkRunner& runner) {
+	const int requests = 512;
+	Matrix& hiddenWeights = createMatrix({ 128, 784 }, true);
+	Matrix& hiddenBiases = createMatrix({ 128 }, true);
+	Matrix& outputWeights = createMatrix({ 10, 128 }, true);
+	Matrix& outputBiases = createMatrix({ 10 }, true);
+
+	std::vector<ModelLayer> model{
+		{ LayerKind::FullyConnected, Activation::Sigmoid, &hiddenWeights, &hiddenBiases },
+		{ LayerKind::FullyConnected, Activation::Linear, &outputWeights, &outputBiases },
+		{ LayerKind::Softmax, Activation::Linear, nullptr, nullptr }
+	};
+
+	struct Variant {
+		const char* name;
+		int maxBatchSize;
+	};
+
+	Variant variants[] = { { "inference/unbatched", 1 }, { "inference/dynamic-batch", 128 } };
+
+	// Whole batch through the compiled plan without the queueing, the upper bound for the engine
+	auto plan = std::make_shared<ExecutionPlan>(GraphCompiler::Compile(model, 128));
+	auto batch = std::make_shared<std::vector<float>>(128 * plan->InputSize(), 0.5f);
+	auto probabilities = std::make_shared<std::vector<float>>(128 * plan->OutputSize());
+
+	BenchmarkCase compiled;
+	compiled.name = "inference/compiled-plan";
+	compiled.backend = "native";
+	compiled.shape = describeShape({ 128, plan->InputSize() });
+	compiled.dtype = "float32";
+	compiled.bytes = 0;
+	compiled.flops = 2.0 * 128 * (784 * 128 + 128 * 10);
+	compiled.run = [plan, batch, probabilities]() { plan->Run(batch->data(), 128, probabilities->data()); };
+	runner.Add(compiled);
+
+	// Layers of different widths share the arena, the chunks of rows run in parallel through all of them
+	std::vector<int> widths{ 256, 2048, 16, 128, 16 };
+	Activation activations[] = { Activation::Sigmoid, Activation::ReLU, Activation::Tanh, Activation::Linear };
+	const int deepBatch = 2048;
+	std::vector<ModelLayer> deepModel;
+	double deepFlops = 0;
+	for (std::size_t i = 0; i + 1 < widths.size(); i++) {
+		deepModel.push_back({ LayerKind::FullyConnected, activations[i], &createMatrix({ widths[i + 1], widths[i] }, true), &createMatrix({ widths[i + 1] }, true) });
+		deepFlops += 2.0 * deepBatch * widths[i] * widths[i + 1];
+	}
+
+	auto deepPlan = std::make_shared<ExecutionPlan>(GraphCompiler::Compile(deepModel, deepBatch));
+	Matrix& deepInput = createMatrix({ deepBatch, widths.front() }, true);
+	auto deepOutput = std::make_shared<std::vector<float>>(static_cast<std::size_t>(deepBatch) * widths.back());
+	auto deepReference = std::make_shared<std::vector<double>>(referenceForward(deepModel, deepInput));
+
+	BenchmarkCase deep;
+	deep.name = "inference/compiled-plan-deep";
+	deep.backend = "native";
+	deep.shape = describeShape({ deepBatch, widths.front() });
+	deep.dtype = "float32";
+	deep.bytes = 0;
+	deep.flops = deepFlops;
+	deep.run = [deepPlan, &deepInput, deepOutput, deepBatch]() { deepPlan->Run(deepInput.data, deepBatch, deepOutput->data()); };
+	deep.check = [deepOutput, deepReference]() { return relativeError(deepOutput->data(), *deepReference); };
+	runner.Add(deep);
+
+	for (const auto& variant : variants) {
+		auto engine = std::make_shared<InferenceEngine>(model, variant.maxBatchSize, 1000);
+		auto input = std::make_shared<std::vector<float>>(engine->InputSize(), 0.5f);
+
+		BenchmarkCase inference;
+		inference.name = variant.name;
+		inference.backend = "native";
+		inference.shape = describeShape({ requests, engine->InputSize() });
+		inference.dtype = "float32";
+		inference.bytes = 0;
+		inference.flops = 2.0 * requests * (784 * 128 + 128 * 10);
+		inference.run = [engine, input, requests]() {
+			std::vector<std::future<std::vector<float>>> results;
+			for (int i = 0; i < requests; i++)
+				results.push_back(engine->Submit(*input));
+
+			for (auto& result : results)
+				result.get();
+		};
+		runner.Add(inference);
+	}
+}
+
+// First layer of a 784-128 network on a batch with MNIST-like density, dense GEMM against CSR
+void addSparseCases(BenchmarkRunner& runner) {
+	const int batch = 128, inputs = 784, outputs = 128;
+	const float density = 0.15f;
+	Matrix& weights = createMatrix({ inputs, outputs }, true);
+	Matrix& result = createMatrix({ batch, outputs }, false);
+	Matrix& samples = createMatrix({ batch, inputs }, true);
+
+	std::vector<float> pixels(samples.shape.size);
+	Random(0, 0).Bernoulli(pixels.data(), 0, samples.shape.size, density);
+	for (int i = 0; i < samples.shape.size; i++)
+		samples.data[i] *= pixels[i];
+
+	auto sparse = std::make_shared<SparseMatrix>(SparseMatrix::FromDense(samples.data, batch, inputs));
+
+	BenchmarkCase dense;
+	dense.name = "sparse/first-layer";
+	dense.backend = "dense-gemm";
+	dense.shape = describeShape({ batch, inputs, outputs });
+	dense.dtype = "float32";
+	dense.bytes = 0;
+	dense.flops = 2.0 * batch * inputs * outputs;
+	dense.run = [&samples, &weights, &result, batch, inputs, outputs]() {
+		result.Fill(0);
+		Kernels().gemm(batch, outputs, inputs, samples.data, inputs, weights.data, outputs, result.data, outputs);
+	};
+	runner.Add(dense);
+
+	BenchmarkCase csr;
+	csr.name = "sparse/first-layer";
+	csr.backend = "csr";
+	csr.shape = describeShape({ batch, inputs, outputs });
+	csr.dtype = "float32";
+	csr.bytes = 0;
+	csr.flops = 2.0 * sparse->NonZeros() * outputs;
+	csr.run = [sparse, &weights, &result, outputs]() {
+		result.Fill(0);
+		sparse->Multiply(weights.data, outputs, outputs, result.data, outputs);
+	};
+	runner.Add(csr);
+
+	BenchmarkCase converted;
+	converted.name = "sparse/first-layer";
+	converted.backend = "csr-with-conversion";
+	converted.shape = describeShape({ batch, inputs, outputs });
+	converted.dtype = "float32";
+	converted.bytes = 0;
+	converted.flops = 2.0 * sparse->NonZeros() * outputs;
+	converted.run = [&samples, &weights, &result, batch, inputs, outputs]() {
+		result.Fill(0);
+		SparseMatrix::FromDense(samples.data, batch, inputs).Multiply(weights.data, outputs, outputs, result.data, outputs);
+	};
+	runner.Add(converted);
+}
+
+// Accuracy and cost of a whole MNIST sized test set, evaluated after every generation
+void addMetricsCases(BenchmarkRunner& runner) {
+	std::vector<int> dimensions{ 10000, 10 };
+	Matrix& outputs = createMatrix(dimensions, true);
+	Matrix& expected = createMatrix(dimensions, true);
+
+	// Host references in double, ties of the maxima go to the first position like in the ArgMax reduction
+	int samples = dimensions[0], classes = dimensions[1], correct = 0;
+	double squaredErrors = 0;
+	for (int sample = 0; sample < samples; sample++) {
+		const float* output = outputs.data + sample * classes;
+		const float* label = expected.data + sample * classes;
+		correct += std::max_element(output, output + classes) - output == std::max_element(label, label + classes) - label;
+
+		for (int i = 0; i < classes; i++)
+			squaredErrors += (static_cast<double>(output[i]) - label[i]) * (static_cast<double>(output[i]) - label[i]);
+	}
+
+	std::vector<double> accuracyReference{ 100.0 * correct / samples };
+	std::vector<double> costReference{ squaredErrors / samples };
+
+	for (const auto& info : backends) {
+		Backend backend = info.backend;
+		auto accuracyResult = std::make_shared<float>(0.0f);
+		auto costResult = std::make_shared<float>(0.0f);
+
+		BenchmarkCase accuracy;
+		accuracy.name = "metrics/argmax-accuracy";
+		accuracy.backend = info.name;
+		accuracy.shape = describeShape(dimensions);
+		accuracy.dtype = "float32";
+		accuracy.bytes = 2.0 * sizeof(float) * outputs.shape.size;
+		accuracy.flops = 0;
+		accuracy.run = [&outputs, &expected, backend, accuracyResult]() { *accuracyResult = Metrics::ArgMaxAccuracy(outputs, expected, backend); };
+		accuracy.check = [accuracyResult, accuracyReference]() { return relativeError(accuracyResult.get(), accuracyReference); };
+		runner.Add(accuracy);
+
+		BenchmarkCase cost;
+		cost.name = "metrics/quadratic-cost";
+		cost.backend = info.name;
+		cost.shape = describeShape(dimensions);
+		cost.dtype = "float32";
+		cost.bytes = 2.0 * sizeof(float) * outputs.shape.size;
+		cost.flops = 3.0 * outputs.shape.size;
+		cost.run = [&outputs, &expected, backend, costResult]() { *costResult = Metrics::QuadraticCost(outputs, expected, backend); };
+		cost.check = [costResult, costReference]() { return relativeError(costResult.get(), costReference); };
+		runner.Add(cost);
+	}
+
+	Matrix& gradient = createMatrix(dimensions, false);
+
+	BenchmarkCase loss;
+	loss.name = "metrics/softmax-cross-entropy";
+	loss.backend = "native";
+	loss.shape = describeShape(dimensions);
+	loss.dtype = "float32";
+	loss.bytes = 3.0 * sizeof(float) * outputs.shape.size;
+	loss.flops = 0;
+	loss.run = [&outputs, &expected, &gradient, dimensions]() {
+		SoftmaxCrossEntropy::ForwardBackward(outputs.data, expected.data, dimensions[0], dimensions[1], gradient.data);
+	};
+	runner.Add(loss);
+}
+
+// Whole is the reduction over the materialized expression, streamed reduces it 256 rows at a time
+void addStreamingCases(BenchmarkRunner& runner) {
+	std::vector<int> dimensions{ 4096, 1024 };
+	std::vector<int> reducedDimensions{ 1024 };
+	Matrix& a = createMatrix(dimensions, true);
+	Matrix& b = createMatrix(dimensions, true);
+	Matrix& reduced = createMatrix(reducedDimensions, false);
+	const Operand* expression = &(a * b - a);
+	const Operand* reduction = &expression->Reduce(Reduction::Sum, 0);
+
+	for (const auto& info : backends) {
+		Backend backend = info.backend;
+
+		BenchmarkCase whole;
+		whole.name = "streaming/reduce-rows-whole";
+		whole.backend = info.name;
+		whole.shape = describeShape(dimensions);
+		whole.dtype = "float32";
+		whole.bytes = 2.0 * sizeof(float) * a.shape.size;
+		whole.flops = 3.0 * a.shape.size;
+		whole.run = [reduction, &reduced, backend]() { reduction->AssignTo(&reduced, backend); };
+		runner.Add(whole);
+
+		BenchmarkCase streamed = whole;
+		streamed.name = "streaming/reduce-rows";
+		streamed.run = [expression, &reduced, backend]() {
+			StreamingExecuter(backend, 256).Reduce(*expression, Reduction::Sum, 0, &reduced);
+		};
+		runner.Add(streamed);
+	}
+}
+
+#ifdef __linux__
+// Results of forked workers are written there, the mapping lives as long as the cases
+float* createSharedArray(std::size_t count) {
+	void* memory = mmap(nullptr, count * sizeof(float), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		throw "Can't map the shared results of the workers";
+
+	return static_cast<float*>(memory);
+}
+
+// One epoch of softmax regression with the batches split over the workers, every worker keeps its own copy of the
+// weights and the biases that follow them. Afterwards every rank broadcasts its parameters and rank 0 writes them
+// to results, one after another, so the check sees the copy of every worker
+void trainSoftmaxRegression(DataParallelGroup& group, const Matrix& inputs, const Matrix& transposed, const Matrix& targets, float* results) {
+	const int batch = 256;
+	const float learningRate = 0.1f;
+	const KernelTable& kernels = Kernels();
+	int samples = inputs.shape.dimensionSizes[0], features = inputs.shape.dimensionSizes[1], classes = targets.shape.dimensionSizes[1];
+	int weightsCount = features * classes, parametersCount = weightsCount + classes;
+
+	std::vector<float> parameters(parametersCount, 0.0f), gradient(parametersCount);
+	std::vector<float> logits(batch * classes);
+	float* weights = parameters.data();
+	float* biases = weights + weightsCount;
+	float* weightsGradient = gradient.data();
+	float* biasesGradient = weightsGradient + weightsCount;
+
+	for (int first = 0; first < samples; first += batch) {
+		int from, to;
+		group.Slice(batch, &from, &to);
+		int rows = to - from;
+		from += first;
+
+		for (int i = 0; i < rows; i++)
+			std::memcpy(&logits[i * classes], biases, sizeof(float) * classes);
+		kernels.gemm(rows, classes, features, inputs.data + from * features, features, weights, classes, logits.data(), classes);
+
+		// Gradient of the mean loss of the slice, the workers average them to the one of the batch
+		SoftmaxCrossEntropy::ForwardBackward(logits.data(), targets.data + from * classes, rows, classes, logits.data());
+		kernels.mulScalar(logits.data(), 1.0f / rows, logits.data(), rows * classes);
+
+		std::fill(gradient.begin(), gradient.end(), 0.0f);
+		kernels.gemm(features, classes, rows, transposed.data + from, samples, logits.data(), classes, weightsGradient, classes);
+		group.SubmitGradient(weightsGradient, weightsCount);
+
+		for (int i = 0; i < rows; i++)
+			kernels.add(biasesGradient, &logits[i * classes], biasesGradient, classes);
+		group.SubmitGradient(biasesGradient, classes);
+
+		group.WaitGradients();
+		kernels.scaleAdd(gradient.data(), -learningRate, parameters.data(), parameters.data(), parametersCount);
+	}
+
+	std::vector<float> received(parametersCount);
+	for (int root = 0; root < group.Workers(); root++) {
+		received = parameters;
+		group.Broadcast(received.data(), parametersCount, root);
+
+		if (group.Rank() == 0)
+			std::memcpy(results + static_cast<std::size_t>(root) * parametersCount, received.data(), sizeof(float) * parametersCount);
+	}
+}
+
+// Features are stored transposed as well, the weight gradient of a slice is then a plain GEMM. Every worker has
+// to end with the weights of a single worker training on whole batches
+void addDataParallelCases(BenchmarkRunner& runner) {
+	const int samples = 4096, features = 784, classes = 10;
+	const int parametersCount = features * classes + classes;
+	Matrix& inputs = createMatrix({ samples, features }, true);
+	Matrix& transposed = createMatrix({ features, samples }, false);
+	Matrix& targets = createMatrix({ samples, classes }, false);
+
+	for (int i = 0; i < samples; i++) {
+		for (int j = 0; j < features; j++)
+			transposed.data[j * samples + i] = inputs.data[i * features + j];
+
+		targets.data[i * classes + i % classes] = 1;
+	}
+
+	// Single worker run computed by the first check which needs it
+	std::shared_ptr<std::vector<double>> reference = std::make_shared<std::vector<double>>();
+	float* referenceResults = createSharedArray(parametersCount);
+
+	for (int workers : { 1, 2, 4 }) {
+		float* results = createSharedArray(static_cast<std::size_t>(workers) * parametersCount);
+
+		BenchmarkCase epoch;
+		epoch.name = "parallel/softmax-regression-epoch-" + std::to_string(workers);
+		epoch.backend = "native";
+		epoch.shape = describeShape({ samples, features });
+		epoch.dtype = "float32";
+		epoch.bytes = 0;
+		epoch.flops = 4.0 * samples * features * classes;
+		epoch.run = [&inputs, &transposed, &targets, workers, results]() {
+			DataParallelGroup::Run(workers, [&inputs, &transposed, &targets, results](DataParallelGroup& group) {
+				trainSoftmaxRegression(group, inputs, transposed, targets, results);
+			});
+		};
+		epoch.check = [&inputs, &transposed, &targets, workers, results, reference, referenceResults]() {
+			if (reference->empty()) {
+				DataParallelGroup::Run(1, [&inputs, &transposed, &targets, referenceResults](DataParallelGroup& group) {
+					trainSoftmaxRegression(group, inputs, transposed, targets, referenceResults);
+				});
+				reference->assign(referenceResults, referenceResults + parametersCount);
+			}
+
+			double error = 0;
+			for (int rank = 0; rank < workers; rank++)
+				error = std::max(error, relativeError(results + static_cast<std::size_t>(rank) * parametersCount, *reference));
+
+			return error;
+		};
+		runner.Add(epoch);
+	}
+}
+#endif
+
+void printUsage() {
+	std::cout << "Usage: MatrixLib [--filter text] [--json results.json] [--baseline baseline.json] [--threshold 0.05]\n"
+		<< "                 [--warmup 2] [--repetitions 10] [--min-time-ms 200] [--trace trace.json]\n"
+		<< "Profiling zones and --trace need MatrixLib built with MATRIXLIB_PROFILING\n"
+		<< "Native backend uses the best instruction set of the CPU, MATRIXLIB_ISA=scalar|sse4.2|avx2|avx512 limits it\n"
+		<< "MATRIXLIB_THREADS sets the thread pool size, MATRIXLIB_PIN_THREADS=1 pins its workers to CPUs\n"
+		<< "MATRIXLIB_KERNEL_CACHE sets the OpenCL binary cache directory (off disables it), MATRIXLIB_KERNEL_CACHE_MB its size\n"
+		<< "OpenCL launch sizes and vector widths are tuned on the first launches of a kernel, MATRIXLIB_AUTOTUNE=off keeps the heuristic ones\n"
+		<< "parallel/* cases fork data parallel workers, each one gets a block of the CPUs (Linux only)\n"
+		<< "Exits with 2 when a case regressed against the baseline and 3 when its results don't match the reference\n";
+}
+
+int main(int argc, char** argv) {
+	std::string filter, jsonPath, baselinePath, tracePath;
+	double threshold = 0.05;
+	int warmup = 2;
+	int repetitions = 10;
+	double minimalTimeMs = 200;
+
+	for (int i = 1; i < argc; i++) {
+		std::string argument = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (argument == "--help") {
+			printUsage();
+			return 0;
+		}
+
+		if (value == nullptr) {
+			printUsage();
+			return 1;
+		}
+
+		if (argument == "--filter")
+			filter = value;
+		else if (argument == "--json")
+			jsonPath = value;
+		else if (argument == "--trace")
+			tracePath = value;
+		else if (argument == "--baseline")
+			baselinePath = value;
+		else if (argument == "--threshold")
+			threshold = std::atof(value);
+		else if (argument == "--warmup")
+			warmup = std::atoi(value);
+		else if (argument == "--repetitions")
+			repetitions = std::atoi(value);
+		else if (argument == "--min-time-ms")
+			minimalTimeMs = std::atof(value);
+		else {
+			printUsage();
+			return 1;
+		}
+
+		i++;
+	}
+
+#ifndef MATRIXLIB_PROFILING
+	if (!tracePath.empty()) {
+		std::cerr << "--trace needs MatrixLib built with MATRIXLIB_PROFILING, profiling is compiled out\n";
+		return 1;
+	}
+#endif
+
+	BenchmarkRunner runner(filter, warmup, repetitions, minimalTimeMs * 1000);
+
+	std::vector<std::vector<int>> sizes{ { 64, 64 }, { 256, 256 }, { 1024, 1024 }, { 280, 280, 100 } };
+	for (const auto& dimensions : sizes)
+		addElementwiseCases(runner, dimensions);
+
+	addAliasingCases(runner);
+	addCodegenCase(runner, { 280, 280, 100 });
+	addPreprocessingCases(runner);
+	addSimdCases(runner);
+	addInferenceCases(runner);
+	addSparseCases(runner);
+	addMetricsCases(runner);
+	addStreamingCases(runner);
+#ifdef __linux__
+	addDataParallelCases(runner);
+#endif
+
+	runner.Run();
+
+	int regressions = 0;
+	if (!baselinePath.empty())
+		regressions = runner.CompareWithBaseline(baselinePath, threshold);
+
+	runner.Print();
+
+	if (!jsonPath.empty())
+		runner.WriteJson(jsonPath);
+
+#ifdef MATRIXLIB_PROFILING
+	Profiler::Instance().PrintStats(std::cout);
+
+	if (!tracePath.empty())
+		Profiler::Instance().ExportChromeTrace(tracePath);
+#endif
+
+	if (runner.Failures() != 0)
+		return 3;
+
+	return regressions == 0 ? 0 : 2;
+}
@@ -23,6 +23,11 @@ public:
 		operands.push_back(const_cast<Constant*>(this));
 	}
 
+	inline void Compute(const KernelTable& kernels, int offset, int count, float* out) const override {
+		for (int i = 0; i < count; i++)
+			out[i] = value;
+	}
+
 	inline int Size() const override {
 		return 1;
 	}
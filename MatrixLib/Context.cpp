@@ -1,13 +1,21 @@
 #include "Context.h"
+#include <cctype>
 
 std::string localVarAppendix("L_");
 std::string globalVarAppendix("G_");
 std::string loopVarAppendix("L_L");
 std::string arrayVarAppendix("A_");
 std::string constantVarAppendix("C_");
+std::string hoistedVarAppendix("V_");
 //std::string iterableVarAppendix("I_");
 
-Context::Context() : variablesCount(0), currentLoop(nullptr) {}
+// Loops refer to array elements through this placeholder, it is replaced by a scalar index or a vload/vstore
+// when the loop is generated
+const std::string elementPlaceholder("[@]");
+const std::string loopMarker("@loop ");
+const std::string loopEndMarker("@end");
+
+Context::Context(int vectorWidth, bool useGpu) : loopOpened(false), outputSize(0), rowsLimit(0), vectorWidth(vectorWidth), useGpu(useGpu), finished(false), variablesCount(0) {}
 
 void Context::AddParam(std::string& appendix) {
 	// set type
@@ -18,16 +26,31 @@ void Context::AddParam(std::string& appendix) {
 
 void Context::AddIterable(const Shape& iterableShape) {
 	AddParam(arrayVarAppendix);
-	if (currentLoop == nullptr)
-		createLoop(iterableShape);
 
+	int size = iterableShape.size;
+	if (rowsLimit > 0 && size > 0)
+		size = size / iterableShape.dimensionSizes.front() * rowsLimit;
+
+	iterableSizes[params.back()] = size;
 	evaluationStack.push(params.back());
+
+	// Result is evaluated first and only assigned in the last loop, so the loop before a reduction runs
+	// over the reduced operand
+	if (outputSize == 0) {
+		outputSize = size;
+		return;
+	}
+
+	if (!loopOpened)
+		createLoop(size);
 }
 
 void Context::AddConstant() {
 	AddParam(constantVarAppendix);
-	// As we add constant as a pointer, we need to add * to use its value
-	evaluationStack.push("*" + params.back());
+	// As we add constant as a pointer, its value is read once before the loops
+	std::string hoisted = hoistedVarAppendix + params.back().substr(constantVarAppendix.size());
+	constants.push_back(std::make_pair(hoisted, "*" + params.back()));
+	evaluationStack.push(hoisted);
 }
 
 void Context::AddBinOp(std::string& op) {
@@ -44,6 +67,8 @@ void Context::AddBinOp(const char* op) {
 	if (!(isLocalVar(leftOp) || isLocalVar(rightOp)) && !freeLocalVariables.empty())
 		freeLocalVariables.pop();
 
+	openLoopFor(leftOp, rightOp);
+
 	if (isArray(leftOp))
 	{
 		std::string elementAccessPart;
@@ -97,6 +122,8 @@ void Context::AddSingOp(const char* op) {
 	getVariable(leftOp);
 	evaluationStack.push(leftOp);
 
+	openLoopFor(leftOp, rightOp);
+
 	if (isArray(leftOp))
 	{
 		std::string elementAccessPart;
@@ -114,8 +141,19 @@ void Context::AddSingOp(const char* op) {
 }
 
 void Context::GenerateFile(std::string* output) {
-	//Assign result to output var
-	AddSingOp("=");
+	if (!finished) {
+		// Reduced result is broadcast to the whole output
+		if (!loopOpened && outputSize != 0)
+			createLoop(outputSize);
+
+		//Assign result to output var
+		AddSingOp("=");
+
+		if (loopOpened)
+			CloseLoop();
+
+		finished = true;
+	}
 
 	*output = std::string("__kernel void executable(");
 
@@ -134,19 +172,112 @@ void Context::GenerateFile(std::string* output) {
 	for (auto elemPtr = localVariables.begin(); elemPtr != localVariables.end(); elemPtr++)
 		*output += "float " + *elemPtr + ";\n";
 
-	if (currentLoop != nullptr)
-		CloseLoop();
+	for (auto elemPtr = constants.begin(); elemPtr != constants.end(); elemPtr++)
+		*output += "const float " + elemPtr->first + " = " + elemPtr->second + ";\n";
+
+	for (std::size_t i = 0; i < derectives.size(); i++) {
+		if (derectives[i].compare(0, loopMarker.size(), loopMarker) != 0) {
+			*output += derectives[i] + "\n";
+			continue;
+		}
+
+		const std::pair<std::string, int>& loop = loops[std::stoi(derectives[i].substr(loopMarker.size()))];
+		std::vector<std::string> body;
 
-	for (int i = 0; i < derectives.size(); i++)
-		*output += derectives[i] + "\n";
+		for (i++; derectives[i] != loopEndMarker; i++)
+			body.push_back(derectives[i]);
+
+		generateLoop(loop, body, output);
+	}
 
 	*output += "}";
 }
 
+// Loops which only map elements are split between the work items by the global id, vectors first and then
+// the scalar tail. Loops accumulating into a global variable are run whole by every work item, so each one
+// has the complete reduction for the loops after it; SumOp doesn't emit them, it reduces with its own kernel first
+void Context::generateLoop(const std::pair<std::string, int>& loop, const std::vector<std::string>& body, std::string* output) const {
+	const std::string& index = loop.first;
+	std::string size = std::to_string(loop.second);
+
+	bool reduction = false;
+	for (const std::string& derective : body)
+		reduction = reduction || *derective.c_str() == 'G';
+
+	std::vector<std::string> scalarBody;
+	for (std::string derective : body) {
+		for (std::size_t position = derective.find(elementPlaceholder); position != std::string::npos; position = derective.find(elementPlaceholder, position))
+			derective.replace(position, elementPlaceholder.size(), "[" + index + "]");
+
+		scalarBody.push_back(derective);
+	}
+
+	if (reduction) {
+		*output += "for(int " + index + " = 0; " + index + " < " + size + "; " + index + "++)\n{\n";
+		for (const std::string& derective : scalarBody)
+			*output += derective + "\n";
+		*output += "}\n";
+		return;
+	}
+
+	int vectors = vectorWidth > 1 ? loop.second / vectorWidth : 0;
+	std::string width = std::to_string(vectorWidth);
+
+	if (vectors > 0) {
+		*output += "for(int " + index + " = get_global_id(0); " + index + " < " + std::to_string(vectors) + "; " + index + " += get_global_size(0))\n{\n";
+
+		// Vector locals shadow the scalar ones for the loop body
+		for (const std::string& variable : localVariables)
+			*output += "float" + width + " " + variable + ";\n";
+
+		for (const std::string& derective : body) {
+			std::string vectorized;
+			vectorize(derective, index, &vectorized);
+			*output += vectorized + "\n";
+		}
+
+		*output += "}\n";
+	}
+
+	if (vectors * vectorWidth < loop.second) {
+		*output += "for(int " + index + " = " + std::to_string(vectors * vectorWidth) + " + get_global_id(0); " + index + " < " + size + "; " + index + " += get_global_size(0))\n{\n";
+		for (const std::string& derective : scalarBody)
+			*output += derective + "\n";
+		*output += "}\n";
+	}
+}
+
+// A_n[@]=value; becomes vstoreN(value, index, A_n); and every other A_n[@] becomes vloadN(index, A_n)
+void Context::vectorize(const std::string& derective, const std::string& index, std::string* output) const {
+	std::string width = std::to_string(vectorWidth);
+	std::string text = derective;
+	std::string store;
+
+	std::size_t assignment = text.find(elementPlaceholder + "=");
+	if (*text.c_str() == 'A' && assignment != std::string::npos) {
+		store = text.substr(0, assignment);
+		text = text.substr(assignment + elementPlaceholder.size() + 1);
+		text = text.substr(0, text.find_last_of(';'));
+	}
+
+	for (std::size_t position = text.find(elementPlaceholder); position != std::string::npos; position = text.find(elementPlaceholder, position)) {
+		std::size_t start = position;
+		while (start > 0 && (std::isalnum(static_cast<unsigned char>(text[start - 1])) || text[start - 1] == '_'))
+			start--;
+
+		std::string load = "vload" + width + "(" + index + ", " + text.substr(start, position - start) + ")";
+		text.replace(start, position + elementPlaceholder.size() - start, load);
+		position = start + load.size();
+	}
+
+	// Cast broadcasts a scalar result, e.g. a reduction assigned to the whole output
+	*output = store.empty() ? text : "vstore" + width + "((float" + width + ")(" + text + "), " + index + ", " + store + ");";
+}
+
 void Context::CloseLoop() {
-	derectives.push_back("}");
+	derectives.push_back(loopEndMarker);
 	freeLocalVar();
-	currentLoop = nullptr;
+	loopOpened = false;
 }
 
 void Context::Swap() {
@@ -201,30 +332,31 @@ void Context::initVariable(std::string& variable) {
 	derectives.push_back(derective);
 }
 
-void Context::createLoop(const Shape& loopShape) {
-
-	if (currentLoop != nullptr) {
-		derectives.push_back("}");
-		freeLocalVar();
-	}
+void Context::createLoop(int size) {
+	if (loopOpened)
+		CloseLoop();
 
-	loopVariables.clear();
-	currentLoop = &loopShape;
+	std::string variable;
+	createVariable(loopVarAppendix, &variable);
 
-	int elementsCount = 1;
-	for (std::size_t i = 0; i < loopShape.dimensionSizes.size(); i++) {
-		elementsCount = 1;
+	derectives.push_back(loopMarker + std::to_string(loops.size()));
+	loops.push_back(std::make_pair(variable, size));
+	loopOpened = true;
+}
 
-		for (int j = i + 1; j < loopShape.dimensionSizes.size(); j++)
-			elementsCount *= loopShape.dimensionSizes[j];
+// Operations after a reduction run in a new loop, over their iterable or the output. Locals are vectors in the
+// loops, so an operation on reduced results alone is evaluated in the loop as well
+void Context::openLoopFor(std::string& leftOp, std::string& rightOp) {
+	if (loopOpened)
+		return;
 
-		std::string variable;
-		createVariable(loopVarAppendix, &variable);
-		loopVariables.push_back(std::pair<std::string, std::string >(variable, std::to_string(elementsCount)));
-		derectives.push_back("for(int " + variable + " = 0; " + variable + " < " + std::to_string(loopShape.dimensionSizes[i]) + "; " + variable + "++)");
-	}
+	int size = outputSize;
+	if (isArray(leftOp))
+		size = iterableSizes[leftOp];
+	else if (isArray(rightOp))
+		size = iterableSizes[rightOp];
 
-	derectives.push_back("{");
+	createLoop(size);
 }
 
 void Context::freeLocalVar() {
@@ -237,14 +369,7 @@ void Context::freeLocalVar() {
 }
 
 void Context::getLoopElementAccess(std::string* out) {
-
-	*out = "[";
-
-	for (std::size_t i = 0; i < loopVariables.size() - 1; i++)
-		*out += loopVariables[i].first + "*" + loopVariables[i].second + " + ";
-
-	*out += loopVariables[loopVariables.size() - 1].first;
-	*out += "]";
+	*out = elementPlaceholder;
 }
 
 bool Context::isArray(std::string& variable) {
@@ -4,6 +4,7 @@
 #include <vector>
 #include <stack>
 #include <string>
+#include <unordered_map>
 
 class STORING_ATTR Context {
 private:
@@ -14,14 +15,34 @@ private:
 	std::stack<std::string> freeLocalVariables;
 	std::vector<std::string> params;
 	std::vector<std::string> derectives;
-	const Shape* currentLoop;
-	std::vector<std::pair<std::string, std::string>> loopVariables;
+	// Constants are read once at the kernel start into the hoisted variables
+	std::vector<std::pair<std::string, std::string>> constants;
+	// Operands are contiguous, so every loop runs over one linear index
+	bool loopOpened;
+	std::vector<std::pair<std::string, int>> loops;
+	// Elements of every iterable, a loop runs over the iterables accessed in it
+	std::unordered_map<std::string, int> iterableSizes;
+	int outputSize;
+	// Iterables are generated for this many rows of their outermost dimension, 0 for whole
+	int rowsLimit;
+	int vectorWidth;
+	bool useGpu;
+	bool finished;
 
 	int variablesCount;
 
 public:
 
-	Context();
+	// Loops without reductions are emitted with floatN (N = vectorWidth) vload/vstore and a scalar tail,
+	// vectorWidth 1 keeps them scalar. useGpu is the device of the kernel, operations which launch their own
+	// kernels while being evaluated (e.g. reductions along an axis) run them on the same device
+	Context(int vectorWidth = 4, bool useGpu = false);
+	inline bool UsesGpu() const { return useGpu; }
+	inline int VectorWidth() const { return vectorWidth; }
+	// Only changes the emitted loops, so the source can be generated again with another width
+	inline void SetVectorWidth(int width) { vectorWidth = width; }
+	// Kernel for the first rows of the operands only (e.g. a chunk of streamed rows), set before the evaluation
+	inline void LimitRows(int rows) { rowsLimit = rows; }
 	void AddParam(std::string& appendix);
 	void AddIterable(const Shape& iterableShape);
 	void AddConstant();
@@ -31,14 +52,18 @@ public:
 	void AddSingOp(std::string& action);
 	void Swap();
 	void CreateOrGetGlobalVariable(std::string* stringOut);
+	// The first call completes the expression with the output assignment, later calls emit the same kernel again
 	void GenerateFile(std::string* output);
 	void CloseLoop();
 
 private:
 	void createVariable(std::string& appendix, std::string* stringOut);
 	void createOrGetLocalVariable(std::string* stringOut);
-	void createLoop(const Shape& loopShape);
+	void createLoop(int size);
+	void openLoopFor(std::string& leftOp, std::string& rightOp);
 	void getLoopElementAccess(std::string* stringOut);
+	void generateLoop(const std::pair<std::string, int>& loop, const std::vector<std::string>& body, std::string* output) const;
+	void vectorize(const std::string& derective, const std::string& index, std::string* output) const;
 	void getVariable(std::string&);
 	void initVariable(std::string& variable);
 	bool isLocalVar(std::string& variable);
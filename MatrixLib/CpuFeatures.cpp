@@ -0,0 +1,136 @@
+#include "CpuFeatures.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <immintrin.h>
+#define CPU_FEATURES_X86
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define CPU_FEATURES_X86
+#endif
+
+const int notForced = -1;
+std::atomic<int> forcedLevel(notForced);
+
+#ifdef CPU_FEATURES_X86
+
+void cpuid(int leaf, int subleaf, unsigned int* registers) {
+#ifdef _MSC_VER
+	int values[4];
+	__cpuidex(values, leaf, subleaf);
+	for (int i = 0; i < 4; i++)
+		registers[i] = static_cast<unsigned int>(values[i]);
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+unsigned long long xgetbv() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+IsaLevel detectLevel() {
+	unsigned int registers[4];
+	cpuid(0, 0, registers);
+	unsigned int maxLeaf = registers[0];
+
+	cpuid(1, 0, registers);
+	unsigned int features = registers[2];
+
+	if (!(features & (1u << 20)))
+		return IsaLevel::Scalar;
+
+	bool osxsave = (features & (1u << 27)) != 0;
+	bool avx = (features & (1u << 28)) != 0;
+	bool fma = (features & (1u << 12)) != 0;
+
+	// The OS must save the YMM (and ZMM for AVX-512) state on context switches
+	unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+	bool ymmState = (xcr0 & 0x6) == 0x6;
+	bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+	if (maxLeaf < 7 || !avx || !fma || !ymmState)
+		return IsaLevel::SSE42;
+
+	cpuid(7, 0, registers);
+	unsigned int extended = registers[1];
+
+	if (!(extended & (1u << 5)))
+		return IsaLevel::SSE42;
+
+	if ((extended & (1u << 16)) && zmmState)
+		return IsaLevel::AVX512;
+
+	return IsaLevel::AVX2;
+}
+
+#else
+
+IsaLevel detectLevel() {
+	return IsaLevel::Scalar;
+}
+
+#endif
+
+IsaLevel parseLevel(const char* name, IsaLevel fallback) {
+	const IsaLevel levels[] = { IsaLevel::Scalar, IsaLevel::SSE42, IsaLevel::AVX2, IsaLevel::AVX512 };
+
+	for (IsaLevel level : levels) {
+		if (std::strcmp(name, CpuFeatures::Name(level)) == 0)
+			return level;
+	}
+
+	return fallback;
+}
+
+IsaLevel CpuFeatures::Detect() {
+	static const IsaLevel detected = detectLevel();
+	return detected;
+}
+
+IsaLevel CpuFeatures::Active() {
+	int forced = forcedLevel.load(std::memory_order_relaxed);
+	if (forced != notForced)
+		return static_cast<IsaLevel>(forced);
+
+	static const IsaLevel active = []() {
+		const char* variable = std::getenv("MATRIXLIB_ISA");
+		IsaLevel level = variable == nullptr ? Detect() : parseLevel(variable, Detect());
+		return level > Detect() ? Detect() : level;
+	}();
+
+	return active;
+}
+
+void CpuFeatures::ForceLevel(IsaLevel level) {
+	if (level > Detect())
+		throw "Instruction set is not supported by this CPU";
+
+	forcedLevel.store(static_cast<int>(level));
+}
+
+void CpuFeatures::ResetLevel() {
+	forcedLevel.store(notForced);
+}
+
+const char* CpuFeatures::Name(IsaLevel level) {
+	switch (level) {
+	case IsaLevel::SSE42:
+		return "sse4.2";
+	case IsaLevel::AVX2:
+		return "avx2";
+	case IsaLevel::AVX512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "Exportable.h"
+
+// Instruction set levels native kernels are compiled for, every level includes the previous ones
+enum class IsaLevel {
+	Scalar = 0,
+	SSE42 = 1,
+	AVX2 = 2,
+	AVX512 = 3
+};
+
+class STORING_ATTR CpuFeatures {
+public:
+	// Highest level supported by both the CPU and the OS (checked with CPUID and XGETBV)
+	static IsaLevel Detect();
+	// Level used by the kernels: the forced one, MATRIXLIB_ISA environment variable or the detected one
+	static IsaLevel Active();
+	// Forcing a level above the detected one throws, as its kernels would fault
+	static void ForceLevel(IsaLevel level);
+	static void ResetLevel();
+	static const char* Name(IsaLevel level);
+};
@@ -0,0 +1,401 @@
+#include "DataParallel.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Floats every worker puts into shared memory at a time, 1 MB keeps a chunk of all the workers in the L3 cache
+const int allReduceChunkFloats = 1 << 18;
+// Waiting workers spin this many times before they sleep on the futex
+const int barrierSpins = 4096;
+// Sleeping workers check this often whether another worker failed
+const long failureCheckNanoseconds = 10000000;
+const long childPollNanoseconds = 10000000;
+
+struct SharedBarrier {
+	std::atomic<int> arrived;
+	std::atomic<int> generation;
+};
+
+// Header of the shared memory, the slots of the workers and two result chunks follow it
+struct SharedGroupState {
+	std::atomic<int> failed;
+	// Barrier and Broadcast of the worker threads
+	SharedBarrier workersBarrier;
+	// Chunks reduced by the communication threads
+	SharedBarrier reduceBarrier;
+};
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "Futex needs a plain int");
+
+const std::size_t sharedHeaderBytes = 64 * ((sizeof(SharedGroupState) + 63) / 64);
+
+std::size_t sharedGroupBytes(int workers) {
+	return sharedHeaderBytes + sizeof(float) * static_cast<std::size_t>(workers + 2) * allReduceChunkFloats;
+}
+
+float* sharedSlot(SharedGroupState* shared, int slot) {
+	return reinterpret_cast<float*>(reinterpret_cast<char*>(shared) + sharedHeaderBytes) + static_cast<std::size_t>(slot) * allReduceChunkFloats;
+}
+
+#ifdef __linux__
+// Process shared futex, the memory is mapped by every worker
+void futexWait(std::atomic<int>* word, int expected) {
+	timespec timeout = { 0, failureCheckNanoseconds };
+	syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<int>* word) {
+	syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAKE, 0x7fffffff, nullptr, nullptr, 0);
+}
+
+// The last worker to arrive starts the next generation, the others spin shortly and then sleep until it changes
+void waitBarrier(SharedBarrier& barrier, int workers, const std::atomic<int>& failed) {
+	int generation = barrier.generation.load();
+	if (barrier.arrived.fetch_add(1) == workers - 1) {
+		barrier.arrived.store(0);
+		barrier.generation.fetch_add(1);
+		futexWakeAll(&barrier.generation);
+		return;
+	}
+
+	for (int spin = 0; barrier.generation.load() == generation; spin++) {
+		if (failed.load() != 0)
+			throw "A data parallel worker failed";
+
+		if (spin >= barrierSpins)
+			futexWait(&barrier.generation, generation);
+	}
+}
+
+void markFailed(SharedGroupState* shared) {
+	shared->failed.store(1);
+	futexWakeAll(&shared->workersBarrier.generation);
+	futexWakeAll(&shared->reduceBarrier.generation);
+}
+
+int packageOf(int cpu) {
+	char path[96];
+	std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+
+	int package = 0;
+	std::FILE* file = std::fopen(path, "r");
+	if (file == nullptr)
+		return 0;
+	if (std::fscanf(file, "%d", &package) != 1)
+		package = 0;
+
+	std::fclose(file);
+	return package;
+}
+
+// CPUs of the process sorted by socket and split into contiguous blocks, so a worker stays on one socket
+// when there are at least as many workers as sockets. More workers than CPUs share them round robin
+std::vector<std::vector<int>> cpuBlocks(int workers) {
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+
+	std::vector<std::pair<int, int>> cpus;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &allowed))
+			cpus.push_back(std::make_pair(packageOf(cpu), cpu));
+
+	if (cpus.empty())
+		cpus.push_back(std::make_pair(0, 0));
+
+	std::sort(cpus.begin(), cpus.end());
+
+	int count = static_cast<int>(cpus.size());
+	std::vector<std::vector<int>> blocks(workers);
+	for (int rank = 0; rank < workers; rank++) {
+		int from = workers <= count ? count * rank / workers : rank % count;
+		int to = workers <= count ? count * (rank + 1) / workers : from + 1;
+
+		for (int i = from; i < to; i++)
+			blocks[rank].push_back(cpus[i].second);
+	}
+
+	return blocks;
+}
+
+#endif
+
+DataParallelGroup::DataParallelGroup(SharedGroupState* shared, int rank, int workers) :
+	shared(shared), rank(rank), workers(workers), reducedChunks(0), reducing(false), stopping(false) {
+	communicator = std::thread(&DataParallelGroup::communicate, this);
+}
+
+DataParallelGroup::~DataParallelGroup() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	communicator.join();
+}
+
+void DataParallelGroup::Run(int workers, const std::function<void(DataParallelGroup& group)>& worker) {
+#ifndef __linux__
+	throw "Data parallel training needs Linux";
+#else
+	if (workers < 1)
+		throw "Workers count must be positive";
+
+	std::size_t bytes = sharedGroupBytes(workers);
+	void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		throw "Can't map the shared memory of the workers";
+
+	SharedGroupState* shared = new (memory) SharedGroupState();
+	shared->failed.store(0);
+	shared->workersBarrier.arrived.store(0);
+	shared->workersBarrier.generation.store(0);
+	shared->reduceBarrier.arrived.store(0);
+	shared->reduceBarrier.generation.store(0);
+
+	std::vector<std::vector<int>> cpus = cpuBlocks(workers);
+	std::vector<pid_t> children;
+	pid_t parent = getpid();
+
+	// Buffered output would be written by every child again
+	std::fflush(nullptr);
+
+	for (int rank = 0; rank < workers; rank++) {
+		pid_t child = fork();
+		if (child == 0) {
+			runWorker(shared, rank, workers, parent, cpus[rank], worker);
+		}
+
+		if (child < 0) {
+			markFailed(shared);
+			break;
+		}
+
+		children.push_back(child);
+	}
+
+	bool succeeded = static_cast<int>(children.size()) == workers;
+
+	// Polled, so a worker killed by a signal is noticed while the others wait for it
+	while (!children.empty()) {
+		for (std::size_t i = 0; i < children.size(); ) {
+			int status = 0;
+			pid_t exited = waitpid(children[i], &status, WNOHANG);
+			if (exited == 0) {
+				i++;
+				continue;
+			}
+
+			if (exited < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				succeeded = false;
+				markFailed(shared);
+			}
+
+			children.erase(children.begin() + i);
+		}
+
+		if (!children.empty()) {
+			timespec poll = { 0, childPollNanoseconds };
+			nanosleep(&poll, nullptr);
+		}
+	}
+
+	munmap(memory, bytes);
+
+	if (!succeeded)
+		throw "A data parallel worker failed";
+#endif
+}
+
+#ifdef __linux__
+void DataParallelGroup::runWorker(SharedGroupState* shared, int rank, int workers, int parent, const std::vector<int>& cpus, const std::function<void(DataParallelGroup& group)>& worker) {
+	// Workers don't outlive the training process
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	if (getppid() != parent)
+		_exit(1);
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus)
+		CPU_SET(cpu, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+
+	const char* pin = std::getenv("MATRIXLIB_PIN_THREADS");
+	ThreadPool::ReplaceInForkedChild(static_cast<int>(cpus.size()), pin != nullptr && std::strcmp(pin, "1") == 0);
+
+	int status = 0;
+	try {
+		// The group is destroyed before the exit, its communication thread stops when it fails
+		DataParallelGroup group(shared, rank, workers);
+		try {
+			worker(group);
+			group.WaitGradients();
+		}
+		catch (...) {
+			markFailed(shared);
+			throw;
+		}
+	}
+	catch (const char* message) {
+		std::fprintf(stderr, "Data parallel worker %d failed: %s\n", rank, message);
+		status = 1;
+	}
+	catch (const std::exception& exception) {
+		std::fprintf(stderr, "Data parallel worker %d failed: %s\n", rank, exception.what());
+		status = 1;
+	}
+	catch (...) {
+		std::fprintf(stderr, "Data parallel worker %d failed\n", rank);
+		status = 1;
+	}
+
+	std::fflush(nullptr);
+	_exit(status);
+}
+#endif
+
+void DataParallelGroup::Slice(int count, int* from, int* to) const {
+	*from = static_cast<int>(static_cast<long long>(count) * rank / workers);
+	*to = static_cast<int>(static_cast<long long>(count) * (rank + 1) / workers);
+}
+
+void DataParallelGroup::SubmitGradient(float* gradient, int count) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (error)
+			std::rethrow_exception(error);
+
+		pending.push_back(std::make_pair(gradient, count));
+	}
+
+	changed.notify_all();
+}
+
+void DataParallelGroup::WaitGradients() {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() { return error || (pending.empty() && !reducing); });
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void DataParallelGroup::Average(float* data, int count) {
+	SubmitGradient(data, count);
+	WaitGradients();
+}
+
+void DataParallelGroup::Barrier() {
+#ifdef __linux__
+	waitBarrier(shared->workersBarrier, workers, shared->failed);
+#endif
+}
+
+// Chunks go through the first result buffer, the barrier before them makes sure no reduction still reads it
+void DataParallelGroup::Broadcast(float* data, int count, int root) {
+	PROFILE_SCOPE("DataParallel broadcast");
+
+	WaitGradients();
+	Barrier();
+
+	float* buffer = sharedSlot(shared, workers);
+	for (int offset = 0; offset < count; offset += allReduceChunkFloats) {
+		std::size_t bytes = sizeof(float) * std::min(allReduceChunkFloats, count - offset);
+
+		if (rank == root)
+			std::memcpy(buffer, data + offset, bytes);
+		Barrier();
+
+		if (rank != root)
+			std::memcpy(data + offset, buffer, bytes);
+		Barrier();
+	}
+}
+
+void DataParallelGroup::communicate() {
+	while (true) {
+		std::pair<float*, int> gradient;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this]() { return stopping || !pending.empty(); });
+			if (pending.empty())
+				return;
+
+			gradient = pending.front();
+			pending.pop_front();
+			reducing = true;
+		}
+
+		std::exception_ptr failure;
+		try {
+			allReduce(gradient.first, gradient.second);
+		}
+		catch (...) {
+			failure = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			reducing = false;
+			if (failure) {
+				error = failure;
+				pending.clear();
+			}
+		}
+
+		changed.notify_all();
+	}
+}
+
+// Every worker copies a chunk into its slot, averages its part of the chunk over all the slots into the result
+// and copies the whole result back. Results alternate between two buffers: a worker writing one has passed the
+// barrier which every worker reaches only after copying the previous result from it
+void DataParallelGroup::allReduce(float* data, int count) {
+#ifdef __linux__
+	PROFILE_SCOPE("DataParallel all-reduce");
+
+	const KernelTable& kernels = Kernels();
+	float* slot = sharedSlot(shared, rank);
+
+	for (int offset = 0; offset < count; offset += allReduceChunkFloats) {
+		int size = std::min(allReduceChunkFloats, count - offset);
+		float* result = sharedSlot(shared, workers + static_cast<int>(reducedChunks % 2));
+		reducedChunks++;
+
+		std::memcpy(slot, data + offset, sizeof(float) * size);
+		waitBarrier(shared->reduceBarrier, workers, shared->failed);
+
+		int from = static_cast<int>(static_cast<long long>(size) * rank / workers);
+		int to = static_cast<int>(static_cast<long long>(size) * (rank + 1) / workers);
+		if (to > from) {
+			std::memcpy(result + from, sharedSlot(shared, 0) + from, sizeof(float) * (to - from));
+			for (int worker = 1; worker < workers; worker++)
+				kernels.add(result + from, sharedSlot(shared, worker) + from, result + from, to - from);
+
+			kernels.mulScalar(result + from, 1.0f / workers, result + from, to - from);
+		}
+
+		waitBarrier(shared->reduceBarrier, workers, shared->failed);
+		std::memcpy(data + offset, result, sizeof(float) * size);
+	}
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include "Exportable.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct SharedGroupState;
+
+// Data parallel training on one Linux machine. Run forks worker processes, each computes the gradients of its
+// slice of every batch and they are averaged over the workers in shared memory: every worker adds up its part of
+// a chunk from all the workers (reduce-scatter) and then copies the whole averaged chunk (all-gather). Workers add
+// in the same order, so they get the same average and the same optimizer step keeps their weights identical.
+// Gradients submitted during the backward pass are reduced by a communication thread while the earlier layers
+// are computed. Every worker gets its own block of CPUs, taken from one socket when possible, and a thread pool
+// of that size
+class STORING_ATTR DataParallelGroup {
+	SharedGroupState* shared;
+	int rank;
+	int workers;
+	// Reduced chunks, the two result buffers take turns by it
+	long long reducedChunks;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::pair<float*, int>> pending;
+	bool reducing;
+	bool stopping;
+	std::exception_ptr error;
+	std::thread communicator;
+
+public:
+	// Calls worker(group) in worker processes and returns when all of them are done. A worker which throws or dies
+	// makes the collective calls of the others throw, Run throws then as well. Linux only
+	static void Run(int workers, const std::function<void(DataParallelGroup& group)>& worker);
+
+	DataParallelGroup(const DataParallelGroup&) = delete;
+	DataParallelGroup& operator = (const DataParallelGroup&) = delete;
+	~DataParallelGroup();
+
+	inline int Rank() const { return rank; }
+	inline int Workers() const { return workers; }
+	// Part [from, to) of count samples which this worker processes
+	void Slice(int count, int* from, int* to) const;
+
+	// Starts averaging the gradient over the workers in the background, it must stay untouched until WaitGradients.
+	// Workers submit gradients of the same sizes in the same order
+	void SubmitGradient(float* gradient, int count);
+	// Returns when every submitted gradient holds the average
+	void WaitGradients();
+	void Average(float* data, int count);
+
+	void Barrier();
+	// Copies the data of the root worker to the others, e.g. the initial weights
+	void Broadcast(float* data, int count, int root = 0);
+
+private:
+	DataParallelGroup(SharedGroupState* shared, int rank, int workers);
+	// Child side of Run, never returns
+	static void runWorker(SharedGroupState* shared, int rank, int workers, int parent, const std::vector<int>& cpus, const std::function<void(DataParallelGroup& group)>& worker);
+	void communicate();
+	void allReduce(float* data, int count);
+};
\ No newline at end of file
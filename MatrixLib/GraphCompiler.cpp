@@ -0,0 +1,356 @@
+#include "GraphCompiler.h"
+#include "SimdKernels.h"
+#include "SoftmaxCrossEntropy.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+// Rows evaluated by one task, a multiple of the GEMM micro-kernel height
+const int rowsPerChunk = 8;
+// Arena offsets are rounded to whole cache lines
+const std::size_t valueAlignment = 16;
+
+const char* activationName(Activation activation) {
+	switch (activation) {
+	case Activation::Sigmoid:
+		return "sigmoid";
+	case Activation::ReLU:
+		return "relu";
+	case Activation::Tanh:
+		return "tanh";
+	default:
+		return "linear";
+	}
+}
+
+std::vector<GraphNode> GraphCompiler::BuildGraph(const std::vector<ModelLayer>& layers) {
+	std::vector<GraphNode> graph;
+	graph.push_back(GraphNode{ NodeKind::Input, -1, 0, Activation::Linear, nullptr });
+
+	for (const ModelLayer& layer : layers) {
+		int last = static_cast<int>(graph.size()) - 1;
+
+		if (layer.kind == LayerKind::FullyConnected) {
+			if (layer.weights == nullptr || layer.weights->shape.GetDimentionsCount() < 2)
+				throw "Fully connected layer must have {outputs, inputs} weights";
+
+			graph.push_back(GraphNode{ NodeKind::MatMul, last, 0, Activation::Linear, layer.weights });
+
+			if (layer.biases != nullptr)
+				graph.push_back(GraphNode{ NodeKind::BiasAdd, last + 1, 0, Activation::Linear, layer.biases });
+			if (layer.activation != Activation::Linear)
+				graph.push_back(GraphNode{ NodeKind::Activate, static_cast<int>(graph.size()) - 1, 0, layer.activation, nullptr });
+		}
+		else if (layer.kind == LayerKind::Softmax) {
+			graph.push_back(GraphNode{ NodeKind::Softmax, last, 0, Activation::Linear, nullptr });
+		}
+		else {
+			throw "Only fully connected and softmax layers can be compiled";
+		}
+	}
+
+	if (graph.size() == 1)
+		throw "Model has no layers";
+
+	return graph;
+}
+
+// Input width comes from the first multiplication, every other node gets its width from its input
+void GraphCompiler::InferShapes(std::vector<GraphNode>& graph) {
+	for (const GraphNode& node : graph) {
+		if (node.kind == NodeKind::MatMul) {
+			graph[0].features = node.parameter->shape.size / node.parameter->shape.dimensionSizes[0];
+			break;
+		}
+	}
+
+	if (graph[0].features == 0)
+		throw "Input size can't be inferred without a fully connected layer";
+
+	for (std::size_t i = 1; i < graph.size(); i++) {
+		GraphNode& node = graph[i];
+		int inputFeatures = graph[node.input].features;
+
+		if (node.kind == NodeKind::MatMul) {
+			int outputs = node.parameter->shape.dimensionSizes[0];
+			if (node.parameter->shape.size / outputs != inputFeatures)
+				throw "Layers sizes don't match";
+
+			node.features = outputs;
+		}
+		else {
+			if (node.kind == NodeKind::BiasAdd && node.parameter->shape.size != inputFeatures)
+				throw "Layers sizes don't match";
+
+			node.features = inputFeatures;
+		}
+	}
+}
+
+ExecutionPlan GraphCompiler::Compile(const std::vector<ModelLayer>& layers, int batchSize) {
+	PROFILE_SCOPE("GraphCompiler::Compile");
+
+	if (batchSize <= 0)
+		throw "Batch size must be positive";
+
+	std::vector<GraphNode> graph = BuildGraph(layers);
+	InferShapes(graph);
+
+	ExecutionPlan plan;
+	plan.batchSize = batchSize;
+	fuse(graph, &plan);
+	planMemory(&plan);
+
+	return plan;
+}
+
+ExecutionPlan GraphCompiler::Compile(const ModelFile& model, int batchSize) {
+	std::vector<ModelLayer> layers;
+	for (int i = 0; i < model.LayersCount(); i++)
+		layers.push_back(model.GetLayer(i));
+
+	return Compile(layers, batchSize);
+}
+
+// The graph is a chain, so a step starts at every multiplication (or at a standalone elementwise node)
+// and absorbs the nodes after it until the next multiplication
+void GraphCompiler::fuse(const std::vector<GraphNode>& graph, ExecutionPlan* plan) {
+	plan->values.push_back(PlanValue{ graph[0].features, -1, -1, 0 });
+
+	for (std::size_t i = 1; i < graph.size(); i++) {
+		const GraphNode& node = graph[i];
+		// Bias always directly follows its multiplication, the activation and softmax are applied in this order
+		bool startsStep = node.kind == NodeKind::MatMul || plan->steps.empty() || plan->steps.back().softmax ||
+			(node.kind == NodeKind::Activate && plan->steps.back().activation != Activation::Linear);
+
+		if (startsStep) {
+			PlanStep step;
+			step.dense = false;
+			step.input = static_cast<int>(plan->values.size()) - 1;
+			step.output = step.input + 1;
+			step.inputs = graph[node.input].features;
+			step.outputs = node.features;
+			step.weights = 0;
+			step.biases = 0;
+			step.activation = Activation::Linear;
+			step.softmax = false;
+
+			plan->steps.push_back(step);
+			plan->values.push_back(PlanValue{ node.features, 0, 0, 0 });
+		}
+
+		PlanStep& step = plan->steps.back();
+		std::vector<float>& parameters = plan->parameters;
+
+		switch (node.kind) {
+		case NodeKind::MatMul: {
+			step.dense = true;
+			step.weights = parameters.size();
+			step.biases = parameters.size() + static_cast<std::size_t>(step.inputs) * step.outputs;
+			parameters.resize(step.biases + step.outputs, 0.0f);
+
+			const float* weights = node.parameter->data;
+			for (int output = 0; output < step.outputs; output++)
+				for (int input = 0; input < step.inputs; input++)
+					parameters[step.weights + static_cast<std::size_t>(input) * step.outputs + output] = weights[output * step.inputs + input];
+			break;
+		}
+		case NodeKind::BiasAdd:
+			for (int output = 0; output < step.outputs; output++)
+				parameters[step.biases + output] += node.parameter->data[output];
+			break;
+		case NodeKind::Activate:
+			step.activation = node.activation;
+			break;
+		case NodeKind::Softmax:
+			step.softmax = true;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// Greedy placement within the arena of one row chunk: values sorted by size from the largest, each goes to the
+// lowest offset that doesn't overlap values already placed whose lifetimes intersect with its own
+void GraphCompiler::planMemory(ExecutionPlan* plan) {
+	std::vector<PlanValue>& values = plan->values;
+	int stepsCount = static_cast<int>(plan->steps.size());
+
+	for (int i = 0; i < stepsCount; i++) {
+		values[plan->steps[i].output].firstStep = i;
+		values[plan->steps[i].output].lastStep = i;
+		values[plan->steps[i].input].lastStep = std::max(values[plan->steps[i].input].lastStep, i);
+	}
+
+	std::vector<int> order;
+	for (int i = 1; i + 1 < static_cast<int>(values.size()); i++)
+		order.push_back(i);
+
+	std::stable_sort(order.begin(), order.end(), [&values](int first, int second) {
+		return values[first].features > values[second].features;
+	});
+
+	std::vector<int> placed;
+	std::size_t arenaSize = 0;
+
+	for (int index : order) {
+		PlanValue& value = values[index];
+		std::size_t size = static_cast<std::size_t>(rowsPerChunk) * value.features;
+		size = (size + valueAlignment - 1) / valueAlignment * valueAlignment;
+
+		std::vector<std::pair<std::size_t, std::size_t>> busy;
+		for (int other : placed) {
+			const PlanValue& placedValue = values[other];
+			if (placedValue.firstStep <= value.lastStep && value.firstStep <= placedValue.lastStep) {
+				std::size_t placedSize = static_cast<std::size_t>(rowsPerChunk) * placedValue.features;
+				busy.push_back(std::make_pair(placedValue.offset, placedValue.offset + (placedSize + valueAlignment - 1) / valueAlignment * valueAlignment));
+			}
+		}
+
+		std::sort(busy.begin(), busy.end());
+
+		std::size_t offset = 0;
+		for (const auto& range : busy) {
+			if (offset + size <= range.first)
+				break;
+
+			offset = std::max(offset, range.second);
+		}
+
+		value.offset = offset;
+		arenaSize = std::max(arenaSize, offset + size);
+		placed.push_back(index);
+	}
+
+	int chunks = (plan->batchSize + rowsPerChunk - 1) / rowsPerChunk;
+	plan->chunkArenaSize = arenaSize;
+	plan->arena.assign(arenaSize * chunks, 0.0f);
+}
+
+std::size_t ExecutionPlan::UnplannedBytes() const {
+	std::size_t total = 0;
+	for (std::size_t i = 1; i + 1 < values.size(); i++)
+		total += static_cast<std::size_t>(batchSize) * values[i].features * sizeof(float);
+
+	return total;
+}
+
+void ExecutionPlan::Run(const float* input, int count, float* output) {
+	PROFILE_SCOPE("ExecutionPlan::Run");
+
+	if (count > batchSize)
+		throw "Batch is larger than the plan was compiled for";
+
+	// Decided for the whole batch, so the chunks don't scan and allocate on their own
+	if (steps.front().dense && SparseMatrix::ShouldBeSparse(SparseMatrix::Density(input, count * InputSize()))) {
+		SparseMatrix sparseInput = SparseMatrix::FromDense(input, count, InputSize());
+		runChunks(nullptr, &sparseInput, count, output);
+	}
+	else {
+		runChunks(input, nullptr, count, output);
+	}
+}
+
+void ExecutionPlan::Run(const SparseMatrix& input, float* output) {
+	PROFILE_SCOPE("ExecutionPlan::Run");
+
+	if (input.Rows() > batchSize)
+		throw "Batch is larger than the plan was compiled for";
+	if (input.Columns() != InputSize())
+		throw "Input doesn't match the plan input size";
+	if (!steps.front().dense)
+		throw "Sparse input needs a fully connected first layer";
+
+	runChunks(nullptr, &input, input.Rows(), output);
+}
+
+// Tasks get whole chunks, so the rows of a chunk always use the arena of that chunk
+void ExecutionPlan::runChunks(const float* input, const SparseMatrix* sparseInput, int count, float* output) {
+	int chunks = (count + rowsPerChunk - 1) / rowsPerChunk;
+
+	ThreadPool::Instance().ParallelFor(chunks, [this, input, sparseInput, count, output](int first, int last) {
+		for (int chunk = first; chunk < last; chunk++)
+			runRows(input, sparseInput, chunk * rowsPerChunk, std::min(count, (chunk + 1) * rowsPerChunk), output);
+	});
+}
+
+// Rows [from, to) of one chunk. Sparse input is only read by the first step, every later one gets dense values
+// from the arena of the chunk
+void ExecutionPlan::runRows(const float* input, const SparseMatrix* sparseInput, int from, int to, float* output) {
+	const KernelTable& kernels = Kernels();
+	int count = to - from;
+	int outputValue = static_cast<int>(values.size()) - 1;
+	float* chunkArena = arena.data() + static_cast<std::size_t>(from / rowsPerChunk) * chunkArenaSize;
+
+	for (const PlanStep& step : steps) {
+		const float* in = step.input != 0 ? chunkArena + values[step.input].offset :
+			input == nullptr ? nullptr : input + static_cast<std::size_t>(from) * step.inputs;
+		float* out = step.output == outputValue ? output + static_cast<std::size_t>(from) * step.outputs : chunkArena + values[step.output].offset;
+		int size = count * step.outputs;
+
+		if (step.dense) {
+			for (int row = 0; row < count; row++)
+				std::memcpy(out + row * step.outputs, parameters.data() + step.biases, step.outputs * sizeof(float));
+
+			const float* weights = parameters.data() + step.weights;
+
+			if (sparseInput != nullptr && step.input == 0) {
+				sparseInput->MultiplyRows(from, to, weights, step.outputs, step.outputs, out, step.outputs);
+			}
+			else {
+				kernels.gemm(count, step.outputs, step.inputs, in, step.inputs, weights, step.outputs, out, step.outputs);
+			}
+		}
+		else {
+			std::memcpy(out, in, size * sizeof(float));
+		}
+
+		switch (step.activation) {
+		case Activation::Sigmoid:
+			kernels.sigmoid(out, out, size);
+			break;
+		case Activation::ReLU:
+			kernels.relu(out, out, size);
+			break;
+		case Activation::Tanh:
+			kernels.tanh(out, out, size);
+			break;
+		default:
+			break;
+		}
+
+		if (step.softmax)
+			SoftmaxCrossEntropy::Softmax(out, count, step.outputs, out);
+	}
+}
+
+std::string ExecutionPlan::Describe() const {
+	std::ostringstream stream;
+	int outputValue = static_cast<int>(values.size()) - 1;
+
+	for (std::size_t i = 0; i < steps.size(); i++) {
+		const PlanStep& step = steps[i];
+		stream << i << ": ";
+
+		if (step.dense)
+			stream << "dense " << step.inputs << "x" << step.outputs << " + bias";
+		else
+			stream << "elementwise " << step.outputs;
+
+		if (step.activation != Activation::Linear)
+			stream << " + " << activationName(step.activation);
+		if (step.softmax)
+			stream << " + softmax";
+
+		if (step.output == outputValue)
+			stream << " -> output\n";
+		else
+			stream << " -> arena[" << values[step.output].offset * sizeof(float) << "]\n";
+	}
+
+	stream << "arena " << ArenaBytes() << " bytes, without planning " << UnplannedBytes() << " bytes\n";
+	return stream.str();
+}
\ No newline at end of file
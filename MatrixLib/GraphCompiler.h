@@ -0,0 +1,100 @@
+#pragma once
+#include "ModelFile.h"
+#include "SparseMatrix.h"
+#include "Exportable.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Operations of the network graph before fusion, one layer becomes several nodes
+enum class NodeKind {
+	Input,
+	MatMul,
+	BiasAdd,
+	Activate,
+	Softmax
+};
+
+struct STORING_ATTR GraphNode {
+	NodeKind kind;
+	int input;
+	int features;
+	Activation activation;
+	const Matrix* parameter;
+};
+
+// Tensor produced by a step, its rows of a chunk live in the arena of the chunk at offset during [firstStep, lastStep]
+struct STORING_ATTR PlanValue {
+	int features;
+	int firstStep;
+	int lastStep;
+	std::size_t offset;
+};
+
+// Fused step: optional matrix multiplication with bias, then activation and softmax applied in place
+struct STORING_ATTR PlanStep {
+	bool dense;
+	int input;
+	int output;
+	int inputs;
+	int outputs;
+	std::size_t weights;
+	std::size_t biases;
+	Activation activation;
+	bool softmax;
+};
+
+class STORING_ATTR ExecutionPlan {
+	friend class GraphCompiler;
+
+	int batchSize;
+	std::vector<PlanStep> steps;
+	// Value 0 is the plan input and the last value is the plan output, both are provided by the caller
+	std::vector<PlanValue> values;
+	// Weights are stored transposed to {inputs, outputs}, so a batch is multiplied by them row-major
+	std::vector<float> parameters;
+	// Every row chunk has its own part of the arena, so the chunks don't overwrite each other's values
+	std::vector<float> arena;
+	std::size_t chunkArenaSize;
+
+public:
+	inline int BatchSize() const { return batchSize; }
+	inline int InputSize() const { return values.front().features; }
+	inline int OutputSize() const { return values.back().features; }
+	inline int StepsCount() const { return static_cast<int>(steps.size()); }
+
+	// Memory of the intermediates after planning and if every one of them had its own buffer
+	inline std::size_t ArenaBytes() const { return arena.size() * sizeof(float); }
+	std::size_t UnplannedBytes() const;
+
+	// Evaluates count <= BatchSize() samples stored one after another. Every op works on rows only,
+	// so row chunks go through all the steps in their arenas on the thread pool without waiting for each other.
+	// Not thread safe, the arena is shared by all calls
+	// Dense batches sparse enough for SparseMatrix::ShouldBeSparse are converted once and go through the first layer
+	// as CSR too
+	void Run(const float* input, int count, float* output);
+	// Rows of the sparse input are the samples, the first layer costs its non-zeros instead of its width
+	void Run(const SparseMatrix& input, float* output);
+	std::string Describe() const;
+
+private:
+	void runChunks(const float* input, const SparseMatrix* sparseInput, int count, float* output);
+	void runRows(const float* input, const SparseMatrix* sparseInput, int from, int to, float* output);
+};
+
+// Turns a whole network into an execution plan: shapes are inferred once, a matrix multiplication is fused
+// with the bias, activation and softmax that follow it (also across layer boundaries) and intermediates are
+// placed into one arena so tensors whose lifetimes don't overlap share memory
+class STORING_ATTR GraphCompiler {
+public:
+	static ExecutionPlan Compile(const std::vector<ModelLayer>& layers, int batchSize);
+	static ExecutionPlan Compile(const ModelFile& model, int batchSize);
+
+	// Separate passes, exposed for inspecting the intermediate results
+	static std::vector<GraphNode> BuildGraph(const std::vector<ModelLayer>& layers);
+	static void InferShapes(std::vector<GraphNode>& graph);
+
+private:
+	static void fuse(const std::vector<GraphNode>& graph, ExecutionPlan* plan);
+	static void planMemory(ExecutionPlan* plan);
+};
\ No newline at end of file
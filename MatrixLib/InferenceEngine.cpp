@@ -0,0 +1,114 @@
+#include "InferenceEngine.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+
+InferenceEngine::InferenceEngine(const std::vector<ModelLayer>& model, int maxBatchSize, int maxDelayUs) :
+	plan(GraphCompiler::Compile(model, std::max(1, maxBatchSize))), maxBatchSize(std::max(1, maxBatchSize)), maxDelay(maxDelayUs), stopping(false), stats{ 0, 0 } {
+	dispatcher = std::thread(&InferenceEngine::dispatch, this);
+}
+
+InferenceEngine::InferenceEngine(const ModelFile& model, int maxBatchSize, int maxDelayUs) :
+	plan(GraphCompiler::Compile(model, std::max(1, maxBatchSize))), maxBatchSize(std::max(1, maxBatchSize)), maxDelay(maxDelayUs), stopping(false), stats{ 0, 0 } {
+	dispatcher = std::thread(&InferenceEngine::dispatch, this);
+}
+
+InferenceEngine::~InferenceEngine() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+
+	requestAdded.notify_all();
+	dispatcher.join();
+}
+
+std::future<std::vector<float>> InferenceEngine::Submit(std::vector<float> input) {
+	if (static_cast<int>(input.size()) != InputSize())
+		throw "Input doesn't match the model input size";
+
+	Request request;
+	request.input = std::move(input);
+	request.arrival = std::chrono::steady_clock::now();
+	std::future<std::vector<float>> result = request.result.get_future();
+
+	bool wakeUp;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopping)
+			throw "Inference engine is stopped";
+
+		queue.push_back(std::move(request));
+		// Dispatcher sleeps until the deadline of the oldest request, it only needs to wake up earlier
+		// for the first request or for a full batch
+		wakeUp = queue.size() == 1 || static_cast<int>(queue.size()) >= maxBatchSize;
+	}
+
+	if (wakeUp)
+		requestAdded.notify_one();
+
+	return result;
+}
+
+std::vector<float> InferenceEngine::Evaluate(const std::vector<float>& input) {
+	return Submit(input).get();
+}
+
+InferenceStats InferenceEngine::Stats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void InferenceEngine::dispatch() {
+	std::vector<Request> batch;
+	std::vector<float> inputs;
+	std::vector<float> outputs;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			requestAdded.wait(lock, [this]() { return stopping || !queue.empty(); });
+
+			if (queue.empty())
+				return;
+
+			std::chrono::steady_clock::time_point deadline = queue.front().arrival + maxDelay;
+			requestAdded.wait_until(lock, deadline, [this]() {
+				return stopping || static_cast<int>(queue.size()) >= maxBatchSize;
+			});
+
+			int count = std::min(maxBatchSize, static_cast<int>(queue.size()));
+			for (int i = 0; i < count; i++) {
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+
+			stats.requests += count;
+			stats.batches++;
+		}
+
+		PROFILE_SCOPE("InferenceEngine batch");
+
+		int count = static_cast<int>(batch.size());
+		int inputSize = InputSize();
+		int outputSize = OutputSize();
+		inputs.resize(static_cast<std::size_t>(count) * inputSize);
+		outputs.resize(static_cast<std::size_t>(count) * outputSize);
+
+		for (int i = 0; i < count; i++)
+			std::memcpy(inputs.data() + i * inputSize, batch[i].input.data(), inputSize * sizeof(float));
+
+		try {
+			plan.Run(inputs.data(), count, outputs.data());
+
+			for (int i = 0; i < count; i++)
+				batch[i].result.set_value(std::vector<float>(outputs.begin() + i * outputSize, outputs.begin() + (i + 1) * outputSize));
+		}
+		catch (...) {
+			for (Request& request : batch)
+				request.result.set_exception(std::current_exception());
+		}
+
+		batch.clear();
+	}
+}
\ No newline at end of file
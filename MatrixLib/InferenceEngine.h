@@ -0,0 +1,63 @@
+#pragma once
+#include "ModelFile.h"
+#include "GraphCompiler.h"
+#include "Exportable.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct STORING_ATTR InferenceStats {
+	long long requests;
+	long long batches;
+
+	inline double AverageBatchSize() const { return batches == 0 ? 0 : static_cast<double>(requests) / batches; }
+};
+
+// Groups single sample requests coming from many threads into batches and evaluates every batch with one
+// forward pass. A batch is started when maxBatchSize requests are waiting or when the oldest waiting request
+// is maxDelayUs old, so the latency added by waiting is bounded by maxDelayUs
+class STORING_ATTR InferenceEngine {
+	struct Request {
+		std::vector<float> input;
+		std::promise<std::vector<float>> result;
+		std::chrono::steady_clock::time_point arrival;
+	};
+
+	// Compiled for maxBatchSize rows, only the dispatcher thread runs it
+	ExecutionPlan plan;
+	int maxBatchSize;
+	std::chrono::microseconds maxDelay;
+
+	std::mutex mutex;
+	std::condition_variable requestAdded;
+	std::deque<Request> queue;
+	bool stopping;
+	InferenceStats stats;
+	std::thread dispatcher;
+
+public:
+	// Fully connected layers keep weights as {outputs, inputs}, softmax layers have no parameters.
+	// The model is compiled into an execution plan with its own copy of the weights, so it doesn't need to outlive the engine
+	InferenceEngine(const std::vector<ModelLayer>& model, int maxBatchSize = 128, int maxDelayUs = 2000);
+	InferenceEngine(const ModelFile& model, int maxBatchSize = 128, int maxDelayUs = 2000);
+	// Requests still waiting are evaluated before the engine stops
+	~InferenceEngine();
+
+	InferenceEngine(const InferenceEngine&) = delete;
+	InferenceEngine& operator = (const InferenceEngine&) = delete;
+
+	// Thread safe, input must have InputSize() values
+	std::future<std::vector<float>> Submit(std::vector<float> input);
+	std::vector<float> Evaluate(const std::vector<float>& input);
+
+	inline int InputSize() const { return plan.InputSize(); }
+	inline int OutputSize() const { return plan.OutputSize(); }
+	InferenceStats Stats();
+
+private:
+	void dispatch();
+};
\ No newline at end of file
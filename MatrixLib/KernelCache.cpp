@@ -0,0 +1,354 @@
+#include "KernelCache.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+const char cacheMagic[8] = { 'M', 'L', 'K', 'C', 'A', 'C', 'H', 'E' };
+const char* entryExtension = ".bin";
+const char* temporaryExtension = ".tmp";
+const std::uint64_t defaultMaxMegabytes = 256;
+// Eviction goes a bit below the limit, so the next stores don't have to scan the directory again
+const double evictionTarget = 0.9;
+// Temporary files this old are left by processes which died while writing
+const std::time_t abandonedSeconds = 3600;
+
+struct CacheEntryHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t keySize;
+	std::uint64_t binarySize;
+	// Hash of the key and the binary, detects entries damaged on disk
+	std::uint64_t hash;
+};
+
+static_assert(sizeof(CacheEntryHeader) == 32, "Kernel cache header layout changed");
+
+struct CacheFile {
+	std::string path;
+	std::uint64_t size;
+	std::time_t modified;
+};
+
+// FNV-1a, continues from the given hash
+std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t hash = 14695981039346656037ull) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (std::size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+	return hash;
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+#ifdef _WIN32
+const char pathSeparator = '\\';
+
+void createDirectory(const std::string& path) {
+	_mkdir(path.c_str());
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+void touchFile(const std::string& path) {
+	HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(file, nullptr, nullptr, &now);
+	CloseHandle(file);
+}
+
+int processId() {
+	return _getpid();
+}
+
+std::vector<CacheFile> listFiles(const std::string& directory) {
+	std::vector<CacheFile> files;
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return files;
+
+	do {
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		ULARGE_INTEGER time;
+		time.LowPart = data.ftLastWriteTime.dwLowDateTime;
+		time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+
+		// File time counts 100 ns intervals from 1601
+		CacheFile file;
+		file.path = directory + "\\" + data.cFileName;
+		file.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		file.modified = static_cast<std::time_t>(time.QuadPart / 10000000ull - 11644473600ull);
+		files.push_back(file);
+	} while (FindNextFileA(find, &data));
+
+	FindClose(find);
+	return files;
+}
+#else
+const char pathSeparator = '/';
+
+void createDirectory(const std::string& path) {
+	mkdir(path.c_str(), 0755);
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+	return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+void touchFile(const std::string& path) {
+	utime(path.c_str(), nullptr);
+}
+
+int processId() {
+	return static_cast<int>(getpid());
+}
+
+std::vector<CacheFile> listFiles(const std::string& directory) {
+	std::vector<CacheFile> files;
+	DIR* dir = opendir(directory.c_str());
+	if (dir == nullptr)
+		return files;
+
+	while (dirent* entry = readdir(dir)) {
+		CacheFile file;
+		file.path = directory + "/" + entry->d_name;
+
+		struct stat info;
+		if (stat(file.path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+
+		file.size = static_cast<std::uint64_t>(info.st_size);
+		file.modified = info.st_mtime;
+		files.push_back(file);
+	}
+
+	closedir(dir);
+	return files;
+}
+#endif
+
+// Creates every missing directory of the path, the existing ones are left as they are
+void createDirectories(const std::string& path) {
+	for (std::size_t position = 1; position <= path.size(); position++) {
+		if (position == path.size() || path[position] == '/' || path[position] == '\\')
+			createDirectory(path.substr(0, position));
+	}
+}
+
+std::string defaultCacheRoot() {
+#ifdef _WIN32
+	const char* base = std::getenv("LOCALAPPDATA");
+	return base == nullptr ? std::string() : std::string(base) + "\\MatrixLib\\kernels";
+#else
+	const char* base = std::getenv("XDG_CACHE_HOME");
+	if (base != nullptr && *base != '\0')
+		return std::string(base) + "/matrixlib/kernels";
+
+	const char* home = std::getenv("HOME");
+	return home == nullptr ? std::string() : std::string(home) + "/.cache/matrixlib/kernels";
+#endif
+}
+
+KernelCache& KernelCache::Instance() {
+	static KernelCache cache([]() {
+		const char* root = std::getenv("MATRIXLIB_KERNEL_CACHE");
+		if (root == nullptr || *root == '\0')
+			return defaultCacheRoot();
+
+		return std::strcmp(root, "off") == 0 ? std::string() : std::string(root);
+	}(), []() {
+		const char* megabytes = std::getenv("MATRIXLIB_KERNEL_CACHE_MB");
+		std::uint64_t limit = megabytes == nullptr ? 0 : std::strtoull(megabytes, nullptr, 10);
+		return (limit == 0 ? defaultMaxMegabytes : limit) << 20;
+	}());
+
+	return cache;
+}
+
+KernelCache::KernelCache(const std::string& root, std::uint64_t maxBytes) : maxBytes(maxBytes) {
+	if (root.empty())
+		return;
+
+	directory = root + pathSeparator + "v" + std::to_string(Version);
+	createDirectories(directory);
+}
+
+// The source goes last, so the readable part of the key identifies the device and the build
+std::string KernelCache::Key(const std::string& source, const std::string& device, const std::string& driver, const std::string& options) {
+	return device + '\n' + driver + '\n' + options + '\n' + source;
+}
+
+std::uint64_t KernelCache::Hash(const std::string& key) {
+	return hashBytes(key.data(), key.size());
+}
+
+std::string KernelCache::FilePath(const std::string& name) const {
+	return directory.empty() ? std::string() : directory + pathSeparator + name;
+}
+
+std::string KernelCache::entryPath(const std::string& key) const {
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(Hash(key)));
+
+	return FilePath(name + std::string(entryExtension));
+}
+
+bool KernelCache::Load(const std::string& key, std::vector<unsigned char>* binary) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = binaries.find(key);
+		if (found != binaries.end()) {
+			*binary = found->second;
+			return true;
+		}
+	}
+
+	if (directory.empty())
+		return false;
+
+	PROFILE_SCOPE("KernelCache disk load");
+
+	std::string path = entryPath(key);
+	if (!readEntry(path, key, binary))
+		return false;
+
+	touchFile(path);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	binaries[key] = *binary;
+	return true;
+}
+
+bool KernelCache::readEntry(const std::string& path, const std::string& key, std::vector<unsigned char>* binary) const {
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+
+	CacheEntryHeader header;
+	std::string storedKey;
+	bool valid = std::fread(&header, sizeof(header), 1, file) == 1 &&
+		std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) == 0 && header.version == Version &&
+		header.keySize == key.size() && header.binarySize > 0;
+
+	// Sizes of a damaged header are checked against the file before anything is allocated for them
+	if (valid) {
+		long end = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+		valid = end >= 0 && std::fseek(file, sizeof(header), SEEK_SET) == 0 &&
+			static_cast<std::uint64_t>(end) - sizeof(header) - header.keySize == header.binarySize;
+	}
+
+	if (valid) {
+		storedKey.resize(header.keySize);
+		binary->resize(static_cast<std::size_t>(header.binarySize));
+
+		// Keys with the same hash are told apart by the full key stored in the entry
+		valid = std::fread(&storedKey[0], 1, storedKey.size(), file) == storedKey.size() && storedKey == key &&
+			std::fread(binary->data(), 1, binary->size(), file) == binary->size() &&
+			hashBytes(binary->data(), binary->size(), hashBytes(key.data(), key.size())) == header.hash;
+	}
+
+	std::fclose(file);
+	return valid;
+}
+
+void KernelCache::Store(const std::string& key, const std::vector<unsigned char>& binary) {
+	if (binary.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		binaries[key] = binary;
+	}
+
+	if (directory.empty())
+		return;
+
+	PROFILE_SCOPE("KernelCache disk store");
+
+	static std::atomic<int> temporaryCounter(0);
+	std::string path = entryPath(key);
+	std::string temporary = path + "." + std::to_string(processId()) + "." + std::to_string(temporaryCounter++) + temporaryExtension;
+
+	CacheEntryHeader header;
+	std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = Version;
+	header.keySize = static_cast<std::uint32_t>(key.size());
+	header.binarySize = binary.size();
+	header.hash = hashBytes(binary.data(), binary.size(), hashBytes(key.data(), key.size()));
+
+	std::FILE* file = std::fopen(temporary.c_str(), "wb");
+	if (file == nullptr)
+		return;
+
+	bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+		std::fwrite(key.data(), 1, key.size(), file) == key.size() &&
+		std::fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+
+	// Another process may have renamed the same entry in meanwhile, either copy is complete
+	if (std::fclose(file) != 0 || !written || !replaceFile(temporary, path)) {
+		std::remove(temporary.c_str());
+		return;
+	}
+
+	evict();
+}
+
+// Entries that are open in another process may fail to be removed on Windows, they stay for the next eviction
+void KernelCache::evict() {
+	std::vector<CacheFile> entries;
+	std::uint64_t total = 0;
+	std::time_t now = std::time(nullptr);
+
+	for (const CacheFile& file : listFiles(directory)) {
+		if (endsWith(file.path, temporaryExtension)) {
+			if (now - file.modified > abandonedSeconds)
+				std::remove(file.path.c_str());
+		}
+		else if (endsWith(file.path, entryExtension)) {
+			entries.push_back(file);
+			total += file.size;
+		}
+	}
+
+	if (total <= maxBytes)
+		return;
+
+	std::sort(entries.begin(), entries.end(), [](const CacheFile& first, const CacheFile& second) {
+		return first.modified < second.modified;
+	});
+
+	std::uint64_t target = static_cast<std::uint64_t>(maxBytes * evictionTarget);
+	for (const CacheFile& entry : entries) {
+		if (total <= target)
+			break;
+
+		if (std::remove(entry.path.c_str()) == 0)
+			total -= entry.size;
+	}
+}
\ No newline at end of file
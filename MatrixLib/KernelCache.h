@@ -0,0 +1,51 @@
+#pragma once
+#include "Exportable.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiled OpenCL program binaries kept in memory and in a versioned directory on disk, so a new process
+// loads them instead of running the compiler. Entries are keyed by the program source, device name, driver
+// version and build options. Files are written to a temporary name and renamed into place, so processes
+// sharing the directory only ever read complete entries. Loading an entry refreshes its modification time,
+// the least recently used entries are removed when the directory grows over the size limit.
+// MATRIXLIB_KERNEL_CACHE sets the directory ("off" keeps the cache in memory only) and
+// MATRIXLIB_KERNEL_CACHE_MB the size limit
+class STORING_ATTR KernelCache {
+	// Empty when the disk cache is disabled
+	std::string directory;
+	std::uint64_t maxBytes;
+
+	std::mutex mutex;
+	std::unordered_map<std::string, std::vector<unsigned char>> binaries;
+
+public:
+	// Entries written by another version are ignored, they live in a different subdirectory
+	static const std::uint32_t Version = 1;
+
+	static KernelCache& Instance();
+	KernelCache(const std::string& root, std::uint64_t maxBytes);
+
+	KernelCache(const KernelCache&) = delete;
+	KernelCache& operator = (const KernelCache&) = delete;
+
+	static std::string Key(const std::string& source, const std::string& device, const std::string& driver, const std::string& options);
+	// FNV-1a of the key, names the entry files
+	static std::uint64_t Hash(const std::string& key);
+
+	// Thread and process safe, a damaged or foreign entry is a miss
+	bool Load(const std::string& key, std::vector<unsigned char>* binary);
+	void Store(const std::string& key, const std::vector<unsigned char>& binary);
+
+	inline const std::string& Directory() const { return directory; }
+	// Other files kept next to the entries (e.g. tuned launch configurations), empty when the disk cache is disabled
+	std::string FilePath(const std::string& name) const;
+
+private:
+	std::string entryPath(const std::string& key) const;
+	bool readEntry(const std::string& path, const std::string& key, std::vector<unsigned char>* binary) const;
+	void evict();
+};
\ No newline at end of file
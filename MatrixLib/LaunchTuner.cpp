@@ -0,0 +1,168 @@
+#include "LaunchTuner.h"
+#include "KernelCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const char* launchConfigsFile = "launch-configs.txt";
+const int cpuLocalSize = 16;
+const int gpuLocalSize = 64;
+// Work items per compute unit, GPUs need many of them to hide the memory latency
+const int cpuItemsPerUnit = 64;
+const int gpuItemsPerUnit = 1024;
+// Launches timed per candidate, the fastest one counts
+const int samplesPerCandidate = 2;
+
+int roundUpTo(int value, int multiple) {
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+// Vectors of the width are split between the work items, the scalar tail is short
+int launchWorkItems(const LaunchLimits& limits, int vectorWidth) {
+	return std::max(1, limits.workSize / vectorWidth);
+}
+
+int targetGlobalSize(const LaunchLimits& limits) {
+	return std::max(1, limits.computeUnits) * (limits.gpu ? gpuItemsPerUnit : cpuItemsPerUnit);
+}
+
+// Global size is a multiple of the local one (required by OpenCL 1.2) and no larger than the work needs
+LaunchConfig makeLaunchConfig(const LaunchLimits& limits, int vectorWidth, int localSize, int globalSize) {
+	int local = std::max(1, std::min(localSize, limits.maxLocalSize));
+	int needed = roundUpTo(launchWorkItems(limits, vectorWidth), local);
+
+	LaunchConfig config;
+	config.vectorWidth = vectorWidth;
+	config.localSize = local;
+	config.globalSize = std::min(roundUpTo(std::max(globalSize, local), local), needed);
+	return config;
+}
+
+LaunchTuner& LaunchTuner::Instance() {
+	static LaunchTuner tuner(KernelCache::Instance().FilePath(launchConfigsFile), []() {
+		const char* autotune = std::getenv("MATRIXLIB_AUTOTUNE");
+		return autotune == nullptr || std::strcmp(autotune, "off") != 0;
+	}());
+
+	return tuner;
+}
+
+LaunchTuner::LaunchTuner(const std::string& path, bool enabled) : path(path), enabled(enabled) {
+	if (enabled && !path.empty())
+		load();
+}
+
+LaunchConfig LaunchTuner::Heuristic(const LaunchLimits& limits) {
+	return makeLaunchConfig(limits, limits.vectorWidths.front(), limits.gpu ? gpuLocalSize : cpuLocalSize, targetGlobalSize(limits));
+}
+
+std::vector<LaunchConfig> LaunchTuner::Candidates(const LaunchLimits& limits) {
+	LaunchConfig heuristic = Heuristic(limits);
+	int target = targetGlobalSize(limits);
+	std::vector<LaunchConfig> candidates(1, heuristic);
+
+	for (int vectorWidth : limits.vectorWidths) {
+		for (int local : { heuristic.localSize, heuristic.localSize / 4, heuristic.localSize * 4 }) {
+			for (int global : { target, target / 4, target * 4 }) {
+				LaunchConfig candidate = makeLaunchConfig(limits, vectorWidth, local, global);
+				if (std::find(candidates.begin(), candidates.end(), candidate) == candidates.end())
+					candidates.push_back(candidate);
+			}
+		}
+	}
+
+	return candidates;
+}
+
+LaunchConfig LaunchTuner::Next(const std::string& signature, const LaunchLimits& limits, bool* measure) {
+	*measure = false;
+
+	// A single work group already covers the whole work, launch overhead dominates there
+	LaunchConfig heuristic = Heuristic(limits);
+	if (!enabled || heuristic.globalSize <= heuristic.localSize)
+		return heuristic;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry& entry = entries[KernelCache::Hash(signature)];
+	if (entry.tuned && valid(entry.best, limits))
+		return entry.best;
+
+	// New signature, or a loaded configuration the device doesn't accept anymore
+	if (entry.candidates.empty() || entry.tuned) {
+		entry.candidates = Candidates(limits);
+		entry.times.assign(entry.candidates.size(), 0);
+		entry.reports = 0;
+		entry.tuned = false;
+	}
+
+	*measure = true;
+	return entry.candidates[std::min<std::size_t>(entry.reports / samplesPerCandidate, entry.candidates.size() - 1)];
+}
+
+void LaunchTuner::Report(const std::string& signature, const LaunchConfig& config, std::uint64_t nanoseconds) {
+	std::uint64_t key = KernelCache::Hash(signature);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = entries.find(key);
+	if (found == entries.end() || found->second.tuned)
+		return;
+
+	Entry& entry = found->second;
+	auto candidate = std::find(entry.candidates.begin(), entry.candidates.end(), config);
+	if (candidate == entry.candidates.end())
+		return;
+
+	std::uint64_t& time = entry.times[candidate - entry.candidates.begin()];
+	nanoseconds = std::max<std::uint64_t>(nanoseconds, 1);
+	time = time == 0 ? nanoseconds : std::min(time, nanoseconds);
+
+	entry.reports++;
+	if (entry.reports < static_cast<int>(entry.candidates.size()) * samplesPerCandidate)
+		return;
+
+	std::size_t best = 0;
+	for (std::size_t i = 0; i < entry.times.size(); i++)
+		if (entry.times[i] != 0 && (entry.times[best] == 0 || entry.times[i] < entry.times[best]))
+			best = i;
+
+	entry.best = entry.candidates[best];
+	entry.tuned = true;
+	save(key, entry.best);
+}
+
+bool LaunchTuner::valid(const LaunchConfig& config, const LaunchLimits& limits) const {
+	return std::find(limits.vectorWidths.begin(), limits.vectorWidths.end(), config.vectorWidth) != limits.vectorWidths.end() &&
+		config.localSize >= 1 && config.localSize <= limits.maxLocalSize &&
+		config.globalSize >= config.localSize && config.globalSize % config.localSize == 0;
+}
+
+// Lines are appended as signatures get tuned, a later line overrides an earlier one
+void LaunchTuner::load() {
+	std::FILE* file = std::fopen(path.c_str(), "r");
+	if (file == nullptr)
+		return;
+
+	unsigned long long key;
+	LaunchConfig config;
+	while (std::fscanf(file, "%llx %d %d %d", &key, &config.vectorWidth, &config.globalSize, &config.localSize) == 4) {
+		Entry& entry = entries[key];
+		entry.best = config;
+		entry.tuned = true;
+	}
+
+	std::fclose(file);
+}
+
+// A single short append, processes tuning at the same time don't interleave their lines
+void LaunchTuner::save(std::uint64_t key, const LaunchConfig& config) {
+	if (path.empty())
+		return;
+
+	std::FILE* file = std::fopen(path.c_str(), "a");
+	if (file == nullptr)
+		return;
+
+	std::fprintf(file, "%016llx %d %d %d\n", static_cast<unsigned long long>(key), config.vectorWidth, config.globalSize, config.localSize);
+	std::fclose(file);
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+#include "Exportable.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct STORING_ATTR LaunchConfig {
+	// Width of the floatN the kernel source is generated with
+	int vectorWidth;
+	int globalSize;
+	int localSize;
+
+	inline bool operator == (const LaunchConfig& other) const {
+		return vectorWidth == other.vectorWidth && globalSize == other.globalSize && localSize == other.localSize;
+	}
+};
+
+struct STORING_ATTR LaunchLimits {
+	// Elements the kernel loops are split over
+	int workSize;
+	// Widths the source can be generated with, the first one is the preferred
+	std::vector<int> vectorWidths;
+	int computeUnits;
+	int maxLocalSize;
+	bool gpu;
+};
+
+// Online autotuner of the OpenCL launch configurations. The first launches of a kernel signature (the device and
+// the kernel source) try the candidates around the heuristic configuration one after another; once every candidate
+// is timed the fastest one is used and appended to launch-configs.txt in the kernel cache directory, so later
+// processes start tuned. Kernels small enough for one work group and MATRIXLIB_AUTOTUNE=off use the heuristic
+class STORING_ATTR LaunchTuner {
+	struct Entry {
+		std::vector<LaunchConfig> candidates;
+		// Fastest launch of every candidate, 0 until it is timed
+		std::vector<std::uint64_t> times;
+		int reports = 0;
+		bool tuned = false;
+		LaunchConfig best = {};
+	};
+
+	// Empty when the configurations aren't persisted
+	std::string path;
+	bool enabled;
+
+	std::mutex mutex;
+	std::unordered_map<std::uint64_t, Entry> entries;
+
+public:
+	static LaunchTuner& Instance();
+	LaunchTuner(const std::string& path, bool enabled);
+
+	LaunchTuner(const LaunchTuner&) = delete;
+	LaunchTuner& operator = (const LaunchTuner&) = delete;
+
+	// Preferred width, a few work items per compute unit and work groups of the usual device size
+	static LaunchConfig Heuristic(const LaunchLimits& limits);
+	// Heuristic first, then the other widths with 4 times smaller and larger global and local sizes
+	static std::vector<LaunchConfig> Candidates(const LaunchLimits& limits);
+
+	// Configuration of the next launch, measure is set when its time should be reported
+	LaunchConfig Next(const std::string& signature, const LaunchLimits& limits, bool* measure);
+	void Report(const std::string& signature, const LaunchConfig& config, std::uint64_t nanoseconds);
+
+private:
+	bool valid(const LaunchConfig& config, const LaunchLimits& limits) const;
+	void load();
+	void save(std::uint64_t key, const LaunchConfig& config);
+};
\ No newline at end of file
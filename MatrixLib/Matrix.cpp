@@ -1,25 +1,28 @@
 #include "Matrix.h"
+#include "ThreadPool.h"
+#include "Random.h"
 #include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
 
 int Matrix::matrices = 0;
+// Random matrices are generated from this seed with the construction counter as the tensor id
+const std::uint64_t defaultSeed = 0;
 
-Matrix::Matrix(const Shape& shape, bool random) : Operand(shape) {
+Matrix::Matrix(const Shape& shape, bool random) : Operand(shape), ownsData(true) {
 	matrices++;
-	data = (float*)calloc(shape.size, sizeof(float));
+	data = ThreadPool::Instance().AllocateFirstTouch(shape.size);
 
-	if (random) {
-		std::default_random_engine generator(matrices);
-		std::normal_distribution<float> distribution;
-
-		for (int i = 0; i < shape.size; i++)
-			data[i] = distribution(generator);
-	}
+	if (random)
+		Random(defaultSeed, matrices).FillNormal(*this);
 };
 
-Matrix::Matrix(const Shape& shape, float* data) : Operand(shape), data(data) {}
+Matrix::Matrix(const Shape& shape, float* data, bool ownsData) : Operand(shape), ownsData(ownsData), data(data) {}
 
 Matrix::~Matrix() {
-	delete	data;
+	if (ownsData)
+		std::free(data);
 }
 
 void Matrix::Evaluate(Context& context, std::vector<Operand*>& operands) const {
@@ -27,6 +30,24 @@ void Matrix::Evaluate(Context& context, std::vector<Operand*>& operands) const {
 	operands.push_back(const_cast<Matrix*>(this));
 }
 
+void Matrix::Compute(const KernelTable& kernels, int offset, int count, float* out) const {
+	if (out != data + offset)
+		std::memcpy(out, data + offset, count * sizeof(float));
+}
+
+const float* Matrix::Direct(int offset) const {
+	return data + offset;
+}
+
+Overlap Matrix::OverlapWith(const float* other, int size) const {
+	std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(data);
+	std::uintptr_t otherBegin = reinterpret_cast<std::uintptr_t>(other);
+	if (begin >= otherBegin + sizeof(float) * size || otherBegin >= begin + sizeof(float) * Size())
+		return Overlap::None;
+
+	return begin == otherBegin ? Overlap::SameElements : Overlap::OtherElements;
+}
+
 inline float* Matrix::GetData() const {
 	return data;
 }
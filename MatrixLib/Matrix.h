@@ -3,19 +3,24 @@
 
 #include "Operand.h"
 #include "Exportable.h"
-#include <random>
 
 class STORING_ATTR Matrix : public Operand {
 	static int matrices;
+	bool ownsData;
 public:
 	float* data;
 
+	// Random data is normal, use Random directly for a chosen seed and a tensor id independent of the construction order
 	Matrix(const Shape& shape, bool random);
 
-	Matrix(const Shape& shape, float* data);
+	// Owned data is released with std::free, data that isn't owned (e.g. mapped from a file) is left as is
+	Matrix(const Shape& shape, float* data, bool ownsData = true);
 	~Matrix();
 
 	void Evaluate(Context& context, std::vector<Operand*>& operands) const override;
+	void Compute(const KernelTable& kernels, int offset, int count, float* out) const override;
+	const float* Direct(int offset) const override;
+	Overlap OverlapWith(const float* data, int size) const override;
 	void Fill(float content);
 	void Print() const;
 
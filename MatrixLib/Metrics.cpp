@@ -0,0 +1,44 @@
+#include "Metrics.h"
+#include "Operations.h"
+#include "Profiler.h"
+
+void checkMetricShapes(const Matrix& outputs, const Matrix& expected) {
+	if (outputs.shape.GetDimentionsCount() != 2)
+		throw "Outputs must be a {samples, outputs} matrix";
+	if (outputs.shape != expected.shape)
+		throw "Operands doesn't have same shapes";
+}
+
+// Positions of the maxima differ by zero exactly for the correctly classified samples
+float Metrics::ArgMaxAccuracy(const Matrix& outputs, const Matrix& expected, Backend backend) {
+	PROFILE_SCOPE("Metrics::ArgMaxAccuracy");
+	checkMetricShapes(outputs, expected);
+
+	ReduceOp predicted(outputs, Reduction::ArgMax, 1);
+	ReduceOp labels(expected, Reduction::ArgMax, 1);
+	SubtractionOp difference(predicted, labels);
+
+	Matrix result(predicted.shape, false);
+	difference.AssignTo(&result, backend);
+
+	int correct = 0;
+	for (int i = 0; i < result.shape.size; i++)
+		correct += result.data[i] == 0.0f;
+
+	return 100.0f * correct / result.shape.size;
+}
+
+float Metrics::QuadraticCost(const Matrix& outputs, const Matrix& expected, Backend backend) {
+	PROFILE_SCOPE("Metrics::QuadraticCost");
+	checkMetricShapes(outputs, expected);
+
+	SubtractionOp error(outputs, expected);
+	MultiplicationOp squared(error, error);
+	ReduceOp perSample(squared, Reduction::Sum, 1);
+	ReduceOp mean(perSample, Reduction::Mean, 0);
+
+	Matrix result(mean.shape, false);
+	mean.AssignTo(&result, backend);
+
+	return result.data[0];
+}
\ No newline at end of file
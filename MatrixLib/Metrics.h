@@ -0,0 +1,13 @@
+#pragma once
+#include "Matrix.h"
+#include "Exportable.h"
+
+// Evaluation of a whole test set at once: outputs and expected outputs are {samples, outputs} matrices and
+// every metric is a batched reduction on the chosen backend instead of a loop over the samples
+class STORING_ATTR Metrics {
+public:
+	// Percentage of samples whose largest output is at the position of the largest expected output
+	static float ArgMaxAccuracy(const Matrix& outputs, const Matrix& expected, Backend backend = Backend::Native);
+	// Squared errors summed over the outputs of a sample and averaged over the samples
+	static float QuadraticCost(const Matrix& outputs, const Matrix& expected, Backend backend = Backend::Native);
+};
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include "ModelFile.h"
+#include "Profiler.h"
+#include <fstream>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const char modelMagic[8] = { 'M', 'L', 'M', 'O', 'D', 'E', 'L', '\0' };
+const int maxDimensions = 4;
+
+struct ModelHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t layersCount;
+	uint32_t alignment;
+	// Checksum of the layers table that follows the header
+	uint32_t checksum;
+	uint64_t fileSize;
+	uint64_t reserved[4];
+};
+
+struct BlobRecord {
+	uint32_t dimensionsCount;
+	int32_t dimensions[maxDimensions];
+	uint32_t checksum;
+	// Offset from the file start, size is 0 for absent blobs
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct LayerRecord {
+	uint32_t kind;
+	uint32_t activation;
+	BlobRecord weights;
+	BlobRecord biases;
+};
+
+static_assert(sizeof(ModelHeader) == 64, "Model header layout changed");
+static_assert(sizeof(BlobRecord) == 40, "Blob record layout changed");
+static_assert(sizeof(LayerRecord) == 88, "Layer record layout changed");
+
+std::vector<uint32_t> createChecksumTable() {
+	std::vector<uint32_t> table(256);
+
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t value = i;
+		for (int bit = 0; bit < 8; bit++)
+			value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+		table[i] = value;
+	}
+
+	return table;
+}
+
+// CRC-32 of the data
+uint32_t checksum(const void* data, std::size_t size) {
+	static const std::vector<uint32_t> table = createChecksumTable();
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint32_t crc = 0xFFFFFFFFu;
+
+	for (std::size_t i = 0; i < size; i++)
+		crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc ^ 0xFFFFFFFFu;
+}
+
+inline uint64_t alignOffset(uint64_t offset) {
+	return (offset + ModelFile::Alignment - 1) / ModelFile::Alignment * ModelFile::Alignment;
+}
+
+void describeBlob(const Matrix* matrix, uint64_t* offset, BlobRecord* record) {
+	std::memset(record, 0, sizeof(BlobRecord));
+
+	if (matrix == nullptr)
+		return;
+
+	const auto& dimensions = matrix->shape.dimensionSizes;
+	if (dimensions.size() > maxDimensions)
+		throw "Model blobs can't have more than 4 dimensions";
+
+	record->dimensionsCount = static_cast<uint32_t>(dimensions.size());
+	for (std::size_t i = 0; i < dimensions.size(); i++)
+		record->dimensions[i] = dimensions[i];
+
+	record->size = sizeof(float) * static_cast<uint64_t>(matrix->shape.size);
+	record->checksum = checksum(matrix->data, static_cast<std::size_t>(record->size));
+	record->offset = alignOffset(*offset);
+	*offset = record->offset + record->size;
+}
+
+void ModelFile::Save(const std::string& path, const std::vector<ModelLayer>& layers) {
+	std::vector<LayerRecord> records(layers.size());
+	uint64_t offset = sizeof(ModelHeader) + sizeof(LayerRecord) * layers.size();
+
+	for (std::size_t i = 0; i < layers.size(); i++) {
+		records[i].kind = static_cast<uint32_t>(layers[i].kind);
+		records[i].activation = static_cast<uint32_t>(layers[i].activation);
+		describeBlob(layers[i].weights, &offset, &records[i].weights);
+		describeBlob(layers[i].biases, &offset, &records[i].biases);
+	}
+
+	ModelHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, modelMagic, sizeof(modelMagic));
+	header.version = Version;
+	header.layersCount = static_cast<uint32_t>(layers.size());
+	header.alignment = Alignment;
+	header.checksum = checksum(records.data(), sizeof(LayerRecord) * records.size());
+	header.fileSize = offset;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw "Can't create model file";
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(records.data()), sizeof(LayerRecord) * records.size());
+
+	uint64_t position = sizeof(ModelHeader) + sizeof(LayerRecord) * records.size();
+	const char padding[Alignment] = {};
+
+	for (std::size_t i = 0; i < layers.size(); i++) {
+		const Matrix* blobs[2] = { layers[i].weights, layers[i].biases };
+		const BlobRecord* blobRecords[2] = { &records[i].weights, &records[i].biases };
+
+		for (int j = 0; j < 2; j++) {
+			if (blobs[j] == nullptr)
+				continue;
+
+			file.write(padding, static_cast<std::streamsize>(blobRecords[j]->offset - position));
+			file.write(reinterpret_cast<const char*>(blobs[j]->data), static_cast<std::streamsize>(blobRecords[j]->size));
+			position = blobRecords[j]->offset + blobRecords[j]->size;
+		}
+	}
+
+	if (!file)
+		throw "Can't write model file";
+}
+
+ModelFile::ModelFile(const std::string& path, bool verify) : path(path), mapping(nullptr), mappingSize(0), records(nullptr) {
+	PROFILE_SCOPE("ModelFile load");
+
+	map();
+
+	try {
+		parse();
+
+		if (verify && !Verify())
+			throw "Model file checksum mismatch";
+	}
+	catch (...) {
+		unmap();
+		throw;
+	}
+}
+
+ModelFile::~ModelFile() {
+	unmap();
+}
+
+#ifdef _WIN32
+
+void ModelFile::map() {
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		throw "Can't open model file";
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(fileHandle, &size);
+	mappingSize = static_cast<std::size_t>(size.QuadPart);
+
+	// Copy-on-write mapping lets callers modify weights without touching the file
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	mapping = mappingHandle == nullptr ? nullptr : MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0);
+
+	if (mapping == nullptr) {
+		if (mappingHandle != nullptr)
+			CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		throw "Can't map model file";
+	}
+}
+
+void ModelFile::unmap() {
+	if (mapping == nullptr)
+		return;
+
+	UnmapViewOfFile(mapping);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	mapping = nullptr;
+}
+
+void ModelFile::Prefetch(int index) const {
+	const BlobRecord* blobs[2] = { &records[index].weights, &records[index].biases };
+
+	for (auto blob : blobs) {
+		if (blob->size == 0)
+			continue;
+
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = static_cast<char*>(mapping) + blob->offset;
+		range.NumberOfBytes = static_cast<SIZE_T>(blob->size);
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+}
+
+#else
+
+void ModelFile::map() {
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		throw "Can't open model file";
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+		close(descriptor);
+		throw "Can't open model file";
+	}
+
+	mappingSize = static_cast<std::size_t>(status.st_size);
+
+	// Private mapping is copy-on-write, so callers can modify weights without touching the file
+	mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+
+	if (mapping == MAP_FAILED) {
+		mapping = nullptr;
+		throw "Can't map model file";
+	}
+}
+
+void ModelFile::unmap() {
+	if (mapping == nullptr)
+		return;
+
+	munmap(mapping, mappingSize);
+	mapping = nullptr;
+}
+
+void ModelFile::Prefetch(int index) const {
+	const BlobRecord* blobs[2] = { &records[index].weights, &records[index].biases };
+	long pageSize = sysconf(_SC_PAGESIZE);
+
+	for (auto blob : blobs) {
+		if (blob->size == 0)
+			continue;
+
+		// madvise needs a page aligned address
+		uint64_t begin = blob->offset / pageSize * pageSize;
+		madvise(static_cast<char*>(mapping) + begin, static_cast<std::size_t>(blob->offset + blob->size - begin), MADV_WILLNEED);
+	}
+}
+
+#endif
+
+void ModelFile::parse() {
+	if (mappingSize < sizeof(ModelHeader))
+		throw "Model file is corrupted";
+
+	const ModelHeader* header = static_cast<const ModelHeader*>(mapping);
+
+	if (std::memcmp(header->magic, modelMagic, sizeof(modelMagic)) != 0)
+		throw "Not a model file";
+	if (header->version > Version)
+		throw "Model file version is not supported";
+	if (header->fileSize > mappingSize || header->alignment % alignof(float) != 0)
+		throw "Model file is corrupted";
+
+	uint64_t tableSize = sizeof(LayerRecord) * static_cast<uint64_t>(header->layersCount);
+	if (sizeof(ModelHeader) + tableSize > mappingSize)
+		throw "Model file is corrupted";
+
+	records = reinterpret_cast<const LayerRecord*>(static_cast<const char*>(mapping) + sizeof(ModelHeader));
+
+	if (checksum(records, static_cast<std::size_t>(tableSize)) != header->checksum)
+		throw "Model file checksum mismatch";
+
+	for (uint32_t i = 0; i < header->layersCount; i++) {
+		ModelLayer layer;
+		layer.kind = static_cast<LayerKind>(records[i].kind);
+		layer.activation = static_cast<Activation>(records[i].activation);
+		layer.weights = createBlob(records[i].weights);
+		layer.biases = createBlob(records[i].biases);
+		layers.push_back(layer);
+	}
+}
+
+const Matrix* ModelFile::createBlob(const BlobRecord& record) {
+	if (record.size == 0)
+		return nullptr;
+
+	// Offset is checked first, so a crafted size can't wrap offset + size around
+	if (record.dimensionsCount > maxDimensions || record.offset % alignof(float) != 0 || record.offset > mappingSize || record.size > mappingSize - record.offset)
+		throw "Model file is corrupted";
+
+	// Product is checked in 64 bits before Shape multiplies the dimensions as ints, a blob with data has at least one
+	uint64_t elements = 1;
+	for (uint32_t i = 0; i < record.dimensionsCount; i++) {
+		if (record.dimensions[i] <= 0 || static_cast<uint64_t>(record.dimensions[i]) > record.size / sizeof(float) / elements)
+			throw "Model file is corrupted";
+		elements *= static_cast<uint64_t>(record.dimensions[i]);
+	}
+
+	if (record.dimensionsCount == 0 || sizeof(float) * elements != record.size)
+		throw "Model file is corrupted";
+
+	std::vector<int> dimensions(record.dimensions, record.dimensions + record.dimensionsCount);
+	Shape shape(dimensions);
+
+	float* data = reinterpret_cast<float*>(static_cast<char*>(mapping) + record.offset);
+	matrices.push_back(std::unique_ptr<Matrix>(new Matrix(shape, data, false)));
+
+	return matrices.back().get();
+}
+
+bool ModelFile::verifyBlob(const BlobRecord& record) const {
+	if (record.size == 0)
+		return true;
+
+	return checksum(static_cast<const char*>(mapping) + record.offset, static_cast<std::size_t>(record.size)) == record.checksum;
+}
+
+bool ModelFile::Verify(int index) const {
+	return verifyBlob(records[index].weights) && verifyBlob(records[index].biases);
+}
+
+bool ModelFile::Verify() const {
+	for (int i = 0; i < LayersCount(); i++) {
+		if (!Verify(i))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "Matrix.h"
+#include "Exportable.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class LayerKind : uint32_t {
+	FullyConnected = 1,
+	Convolutional = 2,
+	Softmax = 3
+};
+
+enum class Activation : uint32_t {
+	Linear = 0,
+	Sigmoid = 1,
+	ReLU = 2,
+	Tanh = 3
+};
+
+// Weights and biases are optional, parameterless layers (e.g. softmax) keep them null
+struct STORING_ATTR ModelLayer {
+	LayerKind kind;
+	Activation activation;
+	const Matrix* weights;
+	const Matrix* biases;
+};
+
+struct BlobRecord;
+struct LayerRecord;
+
+// Versioned model file: a header with the layers topology followed by aligned weight blobs.
+// The file is mapped copy-on-write, so layers' matrices point straight into the mapping and
+// pages are read by the OS only when weights are touched for the first time
+class STORING_ATTR ModelFile {
+	std::string path;
+	void* mapping;
+	std::size_t mappingSize;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+
+	std::vector<std::unique_ptr<Matrix>> matrices;
+	std::vector<ModelLayer> layers;
+	const LayerRecord* records;
+
+public:
+	static const uint32_t Version = 1;
+	static const uint32_t Alignment = 64;
+
+	// Checksums of all blobs are verified on load only when asked, as it pages in the whole file
+	ModelFile(const std::string& path, bool verify = false);
+	~ModelFile();
+
+	ModelFile(const ModelFile&) = delete;
+	ModelFile& operator = (const ModelFile&) = delete;
+
+	static void Save(const std::string& path, const std::vector<ModelLayer>& layers);
+
+	inline int LayersCount() const { return static_cast<int>(layers.size()); }
+	inline const ModelLayer& GetLayer(int index) const { return layers[index]; }
+
+	// Asks the OS to start reading the layer pages in background
+	void Prefetch(int index) const;
+	bool Verify(int index) const;
+	bool Verify() const;
+
+private:
+	void map();
+	void unmap();
+	void parse();
+	const Matrix* createBlob(const BlobRecord& record);
+	bool verifyBlob(const BlobRecord& record) const;
+};
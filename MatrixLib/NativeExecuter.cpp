@@ -0,0 +1,58 @@
+#include "NativeExecuter.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Scheduling a chunk costs more than computing a few tiles
+const int minimalTilesPerChunk = 16;
+
+const int NativeExecuter::TileSize;
+
+NativeExecuter::NativeExecuter() : kernels(Kernels()) {}
+
+void NativeExecuter::Run(const Operand& expression, Operand* target) {
+	PROFILE_SCOPE("Native execution");
+
+	float* out = target->GetData();
+	if (out == nullptr)
+		throw "Native backend can only assign to a matrix";
+	if (target->Size() != expression.Size())
+		throw "Operands doesn't have same shapes";
+
+	expression.Prepare(kernels);
+
+	// Tiles read the leaves after writing into out, so a target which is also a leaf gets the tile through a
+	// scratch tile. A leaf overlapping other elements of the target may be read by another tile after it is
+	// written, the whole result goes to a copy then
+	int size = target->Size();
+	Overlap overlap = expression.OverlapWith(out, size);
+	std::vector<float> copy(overlap == Overlap::OtherElements ? size : 0);
+	float* result = copy.empty() ? out : copy.data();
+
+	ForEachTile(size, [this, &expression, overlap, result](int offset, int count) {
+		if (overlap != Overlap::SameElements) {
+			expression.Compute(kernels, offset, count, result + offset);
+			return;
+		}
+
+		float tile[TileSize];
+		expression.Compute(kernels, offset, count, tile);
+		std::memcpy(result + offset, tile, count * sizeof(float));
+	});
+
+	if (!copy.empty())
+		std::memcpy(out, copy.data(), size * sizeof(float));
+}
+
+void NativeExecuter::ForEachTile(int size, const std::function<void(int offset, int count)>& function) {
+	int tiles = (size + TileSize - 1) / TileSize;
+
+	ThreadPool::Instance().ParallelFor(tiles, [&function, size](int from, int to) {
+		for (int tile = from; tile < to; tile++) {
+			int offset = tile * TileSize;
+			function(offset, std::min(TileSize, size - offset));
+		}
+	}, minimalTilesPerChunk);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "Operand.h"
+#include "SimdKernels.h"
+#include <functional>
+
+// Host backend: evaluates the expression tree tile by tile with the SIMD kernels, tiles are split between threads
+class NativeExecuter {
+public:
+	// Tiles stay in L1 together with the scratch tiles of the nested operations
+	static const int TileSize = 1024;
+
+	NativeExecuter();
+	void Run(const Operand& expression, Operand* target);
+
+	// Calls function(offset, count) for every tile of [0, size) on the library thread pool
+	static void ForEachTile(int size, const std::function<void(int offset, int count)>& function);
+
+private:
+	const KernelTable& kernels;
+};
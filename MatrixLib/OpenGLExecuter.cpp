@@ -1,6 +1,22 @@
 #include "OpenGLExecuter.h"
-#include "Timer.h"
+#include "Profiler.h"
+#include "KernelCache.h"
+#include <algorithm>
 #include <iostream>
+#include <map>
+
+// Widths tried by the launch tuner besides the one preferred by the context
+const int tunedVectorWidths[] = { 1, 4, 8 };
+// Buffer sets (and queues) of streaming, one chunk is transferred while the other is computed
+const int streamSlots = 2;
+
+struct StreamPrograms {
+	StreamKernels kernels;
+	cl::Program expressionProgram;
+	cl::Kernel expression;
+	std::vector<cl::Program> reductionPrograms;
+	std::vector<cl::Kernel> reductions;
+};
 
 OpenGLExecuter::OpenGLExecuter(bool use_gpu) {
 	cl::Platform platform;
@@ -9,24 +25,231 @@ OpenGLExecuter::OpenGLExecuter(bool use_gpu) {
 	std::vector<cl::Device> devices;
 	platform.getDevices(use_gpu ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, &devices);
 
+	if (devices.empty())
+		throw("OpenCL device not found");
+
 	device = devices.front();
 	context = new cl::Context(device);
 
+	deviceName = device.getInfo<CL_DEVICE_NAME>();
+	driverVersion = device.getInfo<CL_DRIVER_VERSION>();
+	computeUnits = static_cast<int>(device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>());
+	maxLocalSize = static_cast<int>(device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+	gpu = use_gpu;
+
+#ifdef MATRIXLIB_PROFILING
+	command_queue = new cl::CommandQueue(*context, device, CL_QUEUE_PROFILING_ENABLE);
+#else
 	command_queue = new cl::CommandQueue(*context, device);
+#endif
 }
 OpenGLExecuter::~OpenGLExecuter() {
 	delete command_queue;
 }
 
+void OpenGLExecuter::Run(Context& context, std::vector<Operand*> operands) {
+	std::vector<int> vectorWidths(1, context.VectorWidth());
+	for (int width : tunedVectorWidths)
+		if (std::find(vectorWidths.begin(), vectorWidths.end(), width) == vectorWidths.end())
+			vectorWidths.push_back(width);
+
+	std::string scalarSource;
+	{
+		PROFILE_SCOPE("Code generation");
+		context.SetVectorWidth(1);
+		context.GenerateFile(&scalarSource);
+	}
+
+	launch(scalarSource, vectorWidths, [&context](int vectorWidth, std::string* source) {
+		PROFILE_SCOPE("Code generation");
+		context.SetVectorWidth(vectorWidth);
+		context.GenerateFile(source);
+	}, operands);
+}
+
 void OpenGLExecuter::Run(std::string* programSrc, std::vector<Operand*> operands) {
+	launch(*programSrc, std::vector<int>(1, 1), [programSrc](int /*vectorWidth*/, std::string* source) {
+		*source = *programSrc;
+	}, operands);
+}
+
+LaunchLimits OpenGLExecuter::launchLimits(int workSize, const std::vector<int>& vectorWidths) const {
+	LaunchLimits limits;
+	limits.workSize = workSize;
+	limits.vectorWidths = vectorWidths;
+	limits.computeUnits = computeUnits;
+	limits.maxLocalSize = maxLocalSize;
+	limits.gpu = gpu;
+	return limits;
+}
+
+void OpenGLExecuter::launch(const std::string& signatureSource, const std::vector<int>& vectorWidths, const std::function<void(int, std::string*)>& generate, std::vector<Operand*>& operands) {
+	LaunchLimits limits = launchLimits(operands.front()->Size(), vectorWidths);
+
+	LaunchTuner& tuner = LaunchTuner::Instance();
+	std::string signature = deviceName + '\n' + driverVersion + '\n' + signatureSource;
+	bool measure;
+	LaunchConfig config = tuner.Next(signature, limits, &measure);
+
+	std::string source;
+	generate(config.vectorWidth, &source);
+
 	cl::Program program;
-	execute(programSrc, &program);
+	execute(&source, &program);
+
+	uint64_t kernelNanoseconds = 0;
+	prepareBuffer(program, operands, config, measure ? &kernelNanoseconds : nullptr);
+
+	if (measure)
+		tuner.Report(signature, config, kernelNanoseconds);
+}
+
+// Launches of the chunks aren't tuned, timing them would stall the pipeline, so they use the heuristic sizes.
+// Every slot's buffers are only used by its own in-order queue, so chunk c + 2 waits for chunk c there
+void OpenGLExecuter::Stream(const std::function<StreamKernels(int rows)>& kernels, std::vector<Operand*> operands, int rows, int chunkRows,
+	float* values, const std::function<float*(int chunk, int result)>& results) {
+	PROFILE_SCOPE("OpenCL stream");
+
+	int totalSize = operands.front()->Size();
+	int rowSize = totalSize / rows;
+	chunkRows = std::min(chunkRows, rows);
+	std::size_t chunkBytes = sizeof(float) * static_cast<std::size_t>(chunkRows) * rowSize;
+	cl_int err = CL_SUCCESS;
+
+	// Full chunks share their programs, only the last one may be shorter
+	std::map<int, StreamPrograms> programs;
+	auto programsFor = [this, &kernels, &programs](int rowsCount) -> StreamPrograms& {
+		StreamPrograms& entry = programs[rowsCount];
+		if (entry.kernels.expression.empty()) {
+			entry.kernels = kernels(rowsCount);
+			execute(&entry.kernels.expression, &entry.expressionProgram);
+			entry.expression = cl::Kernel(entry.expressionProgram, "executable");
+
+			entry.reductionPrograms.resize(entry.kernels.reductions.size());
+			for (std::size_t r = 0; r < entry.kernels.reductions.size(); r++) {
+				execute(&entry.kernels.reductions[r], &entry.reductionPrograms[r]);
+				entry.reductions.push_back(cl::Kernel(entry.reductionPrograms[r], "executable"));
+			}
+		}
+
+		return entry;
+	};
+
+	const StreamKernels& fullKernels = programsFor(chunkRows).kernels;
+
+	cl::CommandQueue secondQueue(*context, device);
+	cl::CommandQueue* queues[streamSlots] = { command_queue, &secondQueue };
+	std::vector<std::vector<cl::Buffer>> buffers(streamSlots);
+	std::vector<std::vector<cl::Buffer>> resultBuffers(streamSlots);
+	std::vector<bool> sliced(operands.size(), true);
+
+	{
+		PROFILE_SCOPE("OpenCL stream buffers");
+
+		for (std::size_t i = 1; i < operands.size(); i++) {
+			if (operands[i]->Size() == totalSize)
+				continue;
+			if (operands[i]->Size() != 1)
+				throw "Streamed operands must have the shape of the expression";
+
+			sliced[i] = false;
+		}
+
+		for (int slot = 0; slot < streamSlots; slot++) {
+			for (std::size_t i = 0; i < operands.size(); i++) {
+				// Constants are uploaded once and shared by the slots
+				if (!sliced[i] && slot > 0) {
+					buffers[slot].push_back(buffers[0][i]);
+					continue;
+				}
+
+				if (sliced[i])
+					buffers[slot].push_back(cl::Buffer(*context, CL_MEM_READ_WRITE, chunkBytes, nullptr, &err));
+				else
+					buffers[slot].push_back(cl::Buffer(*context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float), operands[i]->GetData(), &err));
+
+				err != 0 ? throw("OpenCL Error") : 0;
+			}
+
+			for (int resultSize : fullKernels.resultSizes) {
+				resultBuffers[slot].push_back(cl::Buffer(*context, CL_MEM_WRITE_ONLY, sizeof(float) * resultSize, nullptr, &err));
+				err != 0 ? throw("OpenCL Error") : 0;
+			}
+		}
+	}
+
+	int chunks = (rows + chunkRows - 1) / chunkRows;
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		int slot = chunk % streamSlots;
+		int firstRow = chunk * chunkRows;
+		int rowsCount = std::min(chunkRows, rows - firstRow);
+		std::size_t offset = static_cast<std::size_t>(firstRow) * rowSize;
+		std::size_t bytes = sizeof(float) * static_cast<std::size_t>(rowsCount) * rowSize;
+		cl::CommandQueue& queue = *queues[slot];
+		StreamPrograms& programsOfChunk = programsFor(rowsCount);
+
+		{
+			PROFILE_SCOPE("OpenCL stream enqueue");
 
-	prepareBuffer(program, operands);
+			for (std::size_t i = 1; i < operands.size(); i++) {
+				if (!sliced[i])
+					continue;
 
+				err = queue.enqueueWriteBuffer(buffers[slot][i], CL_FALSE, 0, bytes, operands[i]->GetData() + offset);
+				err != 0 ? throw("OpenCL Error") : 0;
+			}
+
+			for (std::size_t i = 0; i < operands.size(); i++) {
+				err = programsOfChunk.expression.setArg(static_cast<cl_uint>(i), buffers[slot][i]);
+				err != 0 ? throw("OpenCL Error") : 0;
+			}
+
+			LaunchConfig config = LaunchTuner::Heuristic(launchLimits(rowsCount * rowSize, std::vector<int>(1, programsOfChunk.kernels.vectorWidth)));
+			err = queue.enqueueNDRangeKernel(programsOfChunk.expression, cl::NullRange, cl::NDRange(config.globalSize), cl::NDRange(config.localSize));
+			err != 0 ? throw("OpenCL Error") : 0;
+
+			if (programsOfChunk.reductions.empty()) {
+				err = queue.enqueueReadBuffer(buffers[slot][0], CL_FALSE, 0, bytes, values + offset);
+				err != 0 ? throw("OpenCL Error") : 0;
+				continue;
+			}
+
+			for (std::size_t r = 0; r < programsOfChunk.reductions.size(); r++) {
+				cl::Kernel& reduction = programsOfChunk.reductions[r];
+				int resultSize = programsOfChunk.kernels.resultSizes[r];
+
+				err = reduction.setArg(0, resultBuffers[slot][r]);
+				err != 0 ? throw("OpenCL Error") : 0;
+				err = reduction.setArg(1, buffers[slot][0]);
+				err != 0 ? throw("OpenCL Error") : 0;
+
+				config = LaunchTuner::Heuristic(launchLimits(resultSize, std::vector<int>(1, 1)));
+				err = queue.enqueueNDRangeKernel(reduction, cl::NullRange, cl::NDRange(config.globalSize), cl::NDRange(config.localSize));
+				err != 0 ? throw("OpenCL Error") : 0;
+
+				err = queue.enqueueReadBuffer(resultBuffers[slot][r], CL_FALSE, 0, sizeof(float) * resultSize, results(chunk, static_cast<int>(r)));
+				err != 0 ? throw("OpenCL Error") : 0;
+			}
+		}
+	}
+
+	PROFILE_SCOPE("OpenCL stream finish");
+	for (cl::CommandQueue* queue : queues) {
+		err = queue->finish();
+		err != 0 ? throw("OpenCL Error") : 0;
+	}
 }
 
 void OpenGLExecuter::execute(std::string* programSrc, cl::Program* programOut) {
+	const char* options = "-cl-std=CL1.2";
+	KernelCache& cache = KernelCache::Instance();
+	std::string key = KernelCache::Key(*programSrc, deviceName, driverVersion, options);
+
+	std::vector<unsigned char> binary;
+	if (cache.Load(key, &binary) && loadBinary(binary, options, programOut))
+		return;
+
+	PROFILE_SCOPE("OpenCL compile");
 	cl_int err;
 
 	cl::Program::Sources sources(1, std::make_pair(programSrc->c_str(), programSrc->length() + 1));
@@ -34,7 +257,7 @@ void OpenGLExecuter::execute(std::string* programSrc, cl::Program* programOut) {
 
 	err != 0 ? throw("OpenCL Error") : 0;
 
-	err = programOut->build("-cl-std=CL1.2");
+	err = programOut->build(options);
 
 	if (err != 0) {
 		cl_build_status status = programOut->getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device);
@@ -48,50 +271,111 @@ void OpenGLExecuter::execute(std::string* programSrc, cl::Program* programOut) {
 		throw("OpenCL Error");
 	}
 
+	// Program is built for the single device of the context, so it has one binary
+	std::size_t binarySize = 0;
+	if (clGetProgramInfo((*programOut)(), CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, nullptr) != CL_SUCCESS || binarySize == 0)
+		return;
+
+	binary.resize(binarySize);
+	unsigned char* binaryData = binary.data();
+	if (clGetProgramInfo((*programOut)(), CL_PROGRAM_BINARIES, sizeof(binaryData), &binaryData, nullptr) == CL_SUCCESS)
+		cache.Store(key, binary);
+}
+
+// Binaries from another driver build may be rejected even under the same version string, the program
+// is compiled from the source then
+bool OpenGLExecuter::loadBinary(const std::vector<unsigned char>& binary, const char* options, cl::Program* programOut) {
+	PROFILE_SCOPE("OpenCL load binary");
+
+	cl_device_id deviceId = device();
+	const unsigned char* binaryData = binary.data();
+	std::size_t binarySize = binary.size();
+	cl_int status = CL_SUCCESS;
+	cl_int err = CL_SUCCESS;
+
+	cl_program program = clCreateProgramWithBinary((*context)(), 1, &deviceId, &binarySize, &binaryData, &status, &err);
+	if (err != CL_SUCCESS || status != CL_SUCCESS)
+		return false;
+
+	*programOut = cl::Program(program);
+	return programOut->build(options) == CL_SUCCESS;
 }
 
-void OpenGLExecuter::prepareBuffer(cl::Program& program, std::vector<Operand*> operands) {
+void OpenGLExecuter::prepareBuffer(cl::Program& program, std::vector<Operand*> operands, const LaunchConfig& config, uint64_t* kernelNanoseconds) {
 	std::vector<cl::Buffer> buffers;
 	cl_int err;
 
-	Timer timer1;
-
-	cl::Buffer outBuff(*context, CL_MEM_HOST_READ_ONLY | CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR,
-		sizeof(float) * (operands.front()->Size()),
-		operands[0]->GetData(), &err);
-	err != 0 ? throw("OpenCL Error") : 0;
+	{
+		PROFILE_SCOPE("OpenCL upload");
 
-	buffers.push_back(outBuff);
-	for (int i = 1; i < operands.size(); i++) {
-		cl::Buffer inBuff(*context, CL_MEM_HOST_NO_ACCESS | CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR, sizeof(float) * (operands[i]->Size()), operands[i]->GetData());
+		cl::Buffer outBuff(*context, CL_MEM_HOST_READ_ONLY | CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR,
+			sizeof(float) * (operands.front()->Size()),
+			operands[0]->GetData(), &err);
 		err != 0 ? throw("OpenCL Error") : 0;
-		buffers.push_back(inBuff);
+
+		buffers.push_back(outBuff);
+		for (int i = 1; i < operands.size(); i++) {
+			cl::Buffer inBuff(*context, CL_MEM_HOST_NO_ACCESS | CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR, sizeof(float) * (operands[i]->Size()), operands[i]->GetData());
+			err != 0 ? throw("OpenCL Error") : 0;
+			buffers.push_back(inBuff);
+		}
 	}
-	timer1.Stop();
-	Timer timer2;
 
 	cl::Kernel kernel(program, "executable");
 
-	for (int i = 0; i < buffers.size(); i++) {
-		err = kernel.setArg(i, buffers[i]);
-		err != 0 ? throw("OpenCL Error") : 0;
+	{
+		PROFILE_SCOPE("OpenCL bind arguments");
+
+		for (int i = 0; i < buffers.size(); i++) {
+			err = kernel.setArg(i, buffers[i]);
+			err != 0 ? throw("OpenCL Error") : 0;
+		}
 	}
-	timer2.Stop();
 	//auto mem = command_queue->enqueueMapBuffer(outBuff, CL_TRUE, CL_MAP_READ, 0, sizeof(float) * (operands.front()->Size()), nullptr, nullptr, &err);
 	//err != 0 ? throw("OpenCL Error") : 0;
 
-	Timer timer3;
-	err = command_queue->enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(1024), cl::NDRange(16));
-	err != 0 ? throw("OpenCL Error") : 0;
+	cl::Event kernelEvent;
+	cl::Event readEvent;
+#ifdef MATRIXLIB_PROFILING
+	uint64_t enqueueTime = Profiler::Now();
+#endif
+
+	{
+		PROFILE_SCOPE("OpenCL launch");
+
+		uint64_t launchTime = Profiler::Now();
+		err = command_queue->enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(config.globalSize), cl::NDRange(config.localSize), nullptr, &kernelEvent);
+		err != 0 ? throw("OpenCL Error") : 0;
 
-	timer3.Stop();
+		if (kernelNanoseconds != nullptr) {
+			err = kernelEvent.wait();
+			err != 0 ? throw("OpenCL Error") : 0;
+			*kernelNanoseconds = Profiler::Now() - launchTime;
+		}
+	}
 	//err = command_queue->enqueueUnmapMemObject(outBuff, mem, nullptr, nullptr);
 	//err != 0 ? throw("OpenCL Error") : 0;
 
-	Timer timer4;
-	err = command_queue->enqueueReadBuffer(outBuff, CL_TRUE, 0, sizeof(float) * operands[0]->Size(), operands[0]->GetData());
-	err != 0 ? throw("OpenCL Error") : 0;
+	{
+		PROFILE_SCOPE("OpenCL readback");
+
+		err = command_queue->enqueueReadBuffer(buffers[0], CL_TRUE, 0, sizeof(float) * operands[0]->Size(), operands[0]->GetData(), nullptr, &readEvent);
+		err != 0 ? throw("OpenCL Error") : 0;
+
+		cl::finish();
+	}
+
+#ifdef MATRIXLIB_PROFILING
+	recordDeviceTime("OpenCL kernel (device)", kernelEvent, kernelEvent, enqueueTime);
+	recordDeviceTime("OpenCL readback (device)", readEvent, kernelEvent, enqueueTime);
+#endif
+}
 
-	cl::finish();
+// Device timestamps use their own clock, they are shifted so the kernel is queued at the host enqueue time
+void OpenGLExecuter::recordDeviceTime(const char* name, const cl::Event& event, const cl::Event& reference, uint64_t referenceHostTime) {
+	cl_ulong queued = reference.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+	cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
 
+	Profiler::Instance().RecordDevice(name, referenceHostTime + (start - queued), referenceHostTime + (end - queued));
 }
\ No newline at end of file
@@ -11,21 +11,57 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <functional>
 #include "Operand.h"
+#include "Context.h"
+#include "LaunchTuner.h"
+
+// Kernels of one streamed chunk, see OpenGLExecuter::Stream
+struct StreamKernels {
+	// Expression over the rows of the chunk, A_0 is the chunk values
+	std::string expression;
+	int vectorWidth;
+	// Kernels reducing the chunk values (A_1) into their own results (A_0) of resultSizes elements
+	std::vector<std::string> reductions;
+	std::vector<int> resultSizes;
+};
 
 class OpenGLExecuter {
 private:
 	cl::Context* context;
 	cl::Device device;
+	std::string deviceName;
+	std::string driverVersion;
+	int computeUnits;
+	int maxLocalSize;
+	bool gpu;
 	
 	cl::CommandQueue* command_queue;
 
 public:
 	OpenGLExecuter(bool use_gpu);
 	~OpenGLExecuter();
+	// Generated expression, the launch tuner also picks the vector width the kernel is generated with
+	void Run(Context& context, std::vector<Operand*> operands);
+	// Fixed source, only the launch sizes are tuned
 	void Run(std::string* programSrc, std::vector<Operand*> operands);
+	// Rows of the outermost dimension go in chunks through two sets of device buffers on two queues, so the transfers
+	// of one chunk overlap the kernels of the other. The first operand stands for the expression values, the others
+	// are its leaves: arrays of the same size are uploaded a chunk at a time, constants once. kernels(rows) gives
+	// the kernels of a chunk of rows. Without reductions the chunk values are read into values, otherwise result r
+	// of chunk c is read into results(c, r)
+	void Stream(const std::function<StreamKernels(int rows)>& kernels, std::vector<Operand*> operands, int rows, int chunkRows,
+		float* values, const std::function<float*(int chunk, int result)>& results);
 
 private:
+	LaunchLimits launchLimits(int workSize, const std::vector<int>& vectorWidths) const;
+	// Kernels are split over the output elements, the signature source identifies the kernel whatever its width
+	void launch(const std::string& signatureSource, const std::vector<int>& vectorWidths, const std::function<void(int, std::string*)>& generate, std::vector<Operand*>& operands);
+	// Programs are looked up in the kernel cache first, newly compiled ones are stored there
 	void execute(std::string* programSrc, cl::Program* programOut);
-	void prepareBuffer(cl::Program& program, std::vector<Operand*> operands);
+	bool loadBinary(const std::vector<unsigned char>& binary, const char* options, cl::Program* programOut);
+	// Kernel time is measured only when kernelNanoseconds is set, it waits for the kernel before the readback
+	void prepareBuffer(cl::Program& program, std::vector<Operand*> operands, const LaunchConfig& config, uint64_t* kernelNanoseconds);
+	void recordDeviceTime(const char* name, const cl::Event& event, const cl::Event& reference, uint64_t referenceHostTime);
 };
\ No newline at end of file
@@ -1,27 +1,37 @@
 #include "Operations.h"
 #include "Operand.h"
 #include "OpenGLExecuter.h"
+#include "NativeExecuter.h"
 #include "Constant.h"
-#include "Timer.h"
+#include "Profiler.h"
 #include <memory>
 
 Operand::Operand(Shape shape) : shape(shape) {}
-void Operand::AssignTo(Operand* operand) const {
-	std::string generatedFunc;
-	std::vector<Operand*> operands;
+void Operand::AssignTo(Operand* operand, Backend backend) const {
+	PROFILE_SCOPE("AssignTo");
+
+	if (backend == Backend::Native) {
+		NativeExecuter executer;
+		executer.Run(*this, operand);
+		return;
+	}
 
-	Context ctx;
+	std::vector<Operand*> operands;
 
-	operand->Evaluate(ctx, operands);
-	Evaluate(ctx, operands);
+	// Wider vectors suit CPU devices, GPUs mostly have scalar lanes. The width is where the launch tuner starts
+	Context ctx(backend == Backend::OpenCLCpu ? 8 : 4, backend == Backend::OpenCLGpu);
 
-	ctx.GenerateFile(&generatedFunc);
+	{
+		PROFILE_SCOPE("Code generation");
+		operand->Evaluate(ctx, operands);
+		Evaluate(ctx, operands);
+	}
 
 	// TODO Optimize
-	OpenGLExecuter executer(false);
+	OpenGLExecuter executer(backend == Backend::OpenCLGpu);
 	
 	// TODO Optimize
-	executer.Run(&generatedFunc, operands);
+	executer.Run(ctx, operands);
 }
 //
 //Operand& Operand::ElementwiceMultiplication(const Operand& first, const Operand& second) {
@@ -121,6 +131,10 @@ Operand& Operand::operator + (const Operand& other) const {
 Operand& Operand::Sum() const {
 	return *(new SumOp(*this));
 }
+
+Operand& Operand::Reduce(Reduction reduction, int axis, bool keepDims) const {
+	return *(new ReduceOp(*this, reduction, axis, keepDims));
+}
 //
 //Operand& Operand::Sub(const Operand& first, const Operand& second) {
 //	return *(new SubtractionOp(first, second);
@@ -3,6 +3,31 @@
 #include <string>
 #include "Exportable.h"
 #include "Context.h"
+#include "SimdKernels.h"
+
+enum class Backend {
+	OpenCLCpu,
+	OpenCLGpu,
+	// Runs on the host with the SIMD kernels of the active instruction set level
+	Native
+};
+
+// Reductions along one axis, ArgMax gives the index of the first maximum as a float
+enum class Reduction {
+	Sum,
+	Mean,
+	Max,
+	Min,
+	ArgMax
+};
+
+// How the memory read by the tiles of an expression overlaps memory its result is written to
+enum class Overlap {
+	None,
+	// Element i is only read for element i of the result, e.g. x = x * x + x
+	SameElements,
+	OtherElements
+};
 
 class STORING_ATTR Operand{
 public:
@@ -13,10 +38,20 @@ public:
 	virtual ~Operand() {}
 
 	virtual void Evaluate(Context& context, std::vector<Operand*>& operands) const = 0;
-	void AssignTo(Operand* operand) const;
+	void AssignTo(Operand* operand, Backend backend = Backend::OpenCLCpu) const;
 	virtual int Size() const = 0;
 	virtual float* GetData() const = 0;
 
+	// Native backend evaluates the expression tile by tile, Prepare runs once before the tiles (e.g. for reductions)
+	virtual void Prepare(const KernelTable& kernels) const {}
+	virtual void Compute(const KernelTable& kernels, int offset, int count, float* out) const = 0;
+	// Elements from offset if they are already stored contiguously, so they don't need to be copied into a tile
+	virtual const float* Direct(int offset) const { return nullptr; }
+	// Element i depends only on the elements i of the leaves, so the expression can be evaluated in chunks
+	virtual bool Elementwise() const { return true; }
+	// Overlap of the leaves read by Compute with [data, data + size)
+	virtual Overlap OverlapWith(const float* data, int size) const { return Overlap::None; }
+
 	//static Operand* ElementwiceMultiplication(const Operand& first, const Operand& second);
 	//Operand* ElementwiceMultiplication(const Operand& other) const;
 
@@ -55,6 +90,8 @@ public:
 
 	//TODO sum returns Operand& with template paramener of double (constant not matrix) 
 	Operand& Sum() const;
+	// Reduces the axis away, keepDims leaves it with size 1 instead
+	Operand& Reduce(Reduction reduction, int axis, bool keepDims = false) const;
 
 	//static Operand* Sub(const Operand& first, const Operand& second);
 	//Operand* Sub(const Operand& other) const;
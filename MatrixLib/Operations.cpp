@@ -1,13 +1,18 @@
 #include "Operand.h"
 #include "Constant.h"
 #include "Operations.h"
+#include "NativeExecuter.h"
+#include "OpenGLExecuter.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
 #include <algorithm>
+#include <cstring>
 
 float* OperationNode::GetData() const {
 	return nullptr;
 }
 
-BinaryOperation::BinaryOperation(const Operand& leftOp, const Operand& rightOp) : OperationNode(leftOp.shape), LeftOp(leftOp), RightOP(rightOp) {
+BinaryOperation::BinaryOperation(const Operand& leftOp, const Operand& rightOp) : OperationNode(leftOp.shape), _deleteRightOp(false), deletePointer(nullptr), LeftOp(leftOp), RightOP(rightOp) {
 	if (leftOp.shape != rightOp.shape)
 		throw "Operands doesn't have same shapes";
 }
@@ -27,15 +32,58 @@ void BinaryOperation::Evaluate(Context& context, std::vector<Operand*>& operands
 	Apply(context, operands);
 }
 
+void BinaryOperation::Prepare(const KernelTable& kernels) const {
+	LeftOp.Prepare(kernels);
+	RightOP.Prepare(kernels);
+}
+
+// Left operand is computed straight into out, the right one into a scratch tile unless it is stored contiguously.
+// Out never aliases the leaves, NativeExecuter evaluates through a scratch tile when the target is one of them
+void BinaryOperation::Compute(const KernelTable& kernels, int offset, int count, float* out) const {
+	const float* left = LeftOp.Direct(offset);
+	if (left == nullptr) {
+		LeftOp.Compute(kernels, offset, count, out);
+		left = out;
+	}
+
+	if (_deleteRightOp) {
+		ApplyNative(kernels, left, static_cast<const Constant&>(RightOP).value, out, count);
+		return;
+	}
+
+	float scratch[NativeExecuter::TileSize];
+	const float* right = RightOP.Direct(offset);
+	if (right == nullptr) {
+		RightOP.Compute(kernels, offset, count, scratch);
+		right = scratch;
+	}
+
+	ApplyNative(kernels, left, right, out, count);
+}
+
 int BinaryOperation::Size() const {
 	return std::max(LeftOp.Size(), RightOP.Size());
 }
 
+bool BinaryOperation::Elementwise() const {
+	return LeftOp.Elementwise() && RightOP.Elementwise();
+}
+
+Overlap BinaryOperation::OverlapWith(const float* data, int size) const {
+	return std::max(LeftOp.OverlapWith(data, size), RightOP.OverlapWith(data, size));
+}
+
 AdditionOp::AdditionOp(const Operand& leftOp, const Operand& rightOp) : BinaryOperation(leftOp, rightOp) {}
 AdditionOp::AdditionOp(const Operand& leftOp, const float constant) : BinaryOperation(leftOp, constant) {}
 void AdditionOp::Apply(Context& context, std::vector<Operand*>& operands) const {
 	context.AddBinOp("+");
 }
+void AdditionOp::ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const {
+	kernels.add(left, right, out, count);
+}
+void AdditionOp::ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const {
+	kernels.addScalar(left, constant, out, count);
+}
 
 
 SubtractionOp::SubtractionOp(const Operand& leftOp, const Operand& rightOp) : BinaryOperation(leftOp, rightOp) {}
@@ -43,12 +91,24 @@ SubtractionOp::SubtractionOp(const Operand& leftOp, const float constant) : Bina
 void SubtractionOp::Apply(Context& context, std::vector<Operand*>& operands) const {
 	context.AddBinOp("-");
 }
+void SubtractionOp::ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const {
+	kernels.sub(left, right, out, count);
+}
+void SubtractionOp::ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const {
+	kernels.subScalar(left, constant, out, count);
+}
 
 MultiplicationOp::MultiplicationOp(const Operand& leftOp, const Operand& rightOp) : BinaryOperation(leftOp, rightOp) {}
 MultiplicationOp::MultiplicationOp(const Operand& leftOp, const float constant) : BinaryOperation(leftOp, constant) {}
 void MultiplicationOp::Apply(Context& context, std::vector<Operand*>& operands) const {
 	context.AddBinOp("*");
 }
+void MultiplicationOp::ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const {
+	kernels.mul(left, right, out, count);
+}
+void MultiplicationOp::ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const {
+	kernels.mulScalar(left, constant, out, count);
+}
 
 //MatrixMultiplicationOp::MatrixMultiplicationOp(const Operand& leftOp, const Operand& rightOp) : BinaryOperation(leftOp, rightOp) {}
 //void MatrixMultiplicationOp::Apply(Context& context) const {
@@ -60,8 +120,15 @@ DivisionOp::DivisionOp(const Operand& leftOp, const float constant) : BinaryOper
 void DivisionOp::Apply(Context& context, std::vector<Operand*>& operands) const {
 	context.AddBinOp("/");
 }
+void DivisionOp::ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const {
+	kernels.div(left, right, out, count);
+}
+void DivisionOp::ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const {
+	kernels.divScalar(left, constant, out, count);
+}
 
 SingularOperation::SingularOperation(const Operand& operand) : OperationNode(operand.shape), operand(operand) {}
+SingularOperation::SingularOperation(const Operand& operand, const Shape& shape) : OperationNode(shape), operand(operand) {}
 
 void SingularOperation::Evaluate(Context& context, std::vector<Operand*>& operands) const {
 	operand.Evaluate(context, operands);
@@ -72,6 +139,26 @@ int SingularOperation::Size() const {
 	return operand.Size();
 }
 
+void SingularOperation::Prepare(const KernelTable& kernels) const {
+	operand.Prepare(kernels);
+}
+
+void SingularOperation::Compute(const KernelTable& kernels, int offset, int count, float* out) const {
+	operand.Compute(kernels, offset, count, out);
+}
+
+const float* SingularOperation::Direct(int offset) const {
+	return operand.Direct(offset);
+}
+
+bool SingularOperation::Elementwise() const {
+	return operand.Elementwise();
+}
+
+Overlap SingularOperation::OverlapWith(const float* data, int size) const {
+	return operand.OverlapWith(data, size);
+}
+
 ElelmentsSumOp::ElelmentsSumOp(const Operand& operand) : SingularOperation(operand) {}
 void ElelmentsSumOp::Apply(Context& context, std::vector<Operand*>& operands) const {
 
@@ -82,11 +169,328 @@ void MapOp::Apply(Context& context, std::vector<Operand*>& operands) const {
 
 }
 
-SumOp::SumOp(const Operand& operand) : SingularOperation(operand) {}
+// Work items of the OpenCL sum, each one adds a strided slice of the operand so the reads are coalesced
+const int sumPartials = 1024;
+
+// Partial i is the sum of elements i, i + partials, ... of A_1, the sizes are literals like in the expression kernels
+void generatePartialSumsKernel(int size, int partials, std::string* output) {
+	std::string count = std::to_string(partials);
+
+	*output = "__kernel void executable(__global float* A_0, __global float* A_1){\n"
+		"for(int i = get_global_id(0); i < " + count + "; i += get_global_size(0))\n{\n"
+		"float acc = 0;\n"
+		"for(int a = i; a < " + std::to_string(size) + "; a += " + count + ")\n"
+		"acc += A_1[a];\n"
+		"A_0[i] = acc;\n"
+		"}\n"
+		"}";
+}
+
+SumOp::SumOp(const Operand& operand) : SingularOperation(operand), sum(0), total(0.0f) {}
+
+// Partials are added on the host in their order, so the sum doesn't depend on the launch configuration
+void SumOp::Evaluate(Context& context, std::vector<Operand*>& operands) const {
+	PROFILE_SCOPE("SumOp OpenCL");
+
+	const Operand* input = &operand;
+	if (operand.GetData() == nullptr) {
+		if (materialized == nullptr)
+			materialized.reset(new Matrix(operand.shape, false));
+
+		operand.AssignTo(materialized.get(), context.UsesGpu() ? Backend::OpenCLGpu : Backend::OpenCLCpu);
+		input = materialized.get();
+	}
+
+	int size = operand.Size();
+	if (partials == nullptr)
+		partials.reset(new Matrix(Shape({ std::max(1, std::min(size, sumPartials)) }), false));
+
+	std::string source;
+	generatePartialSumsKernel(size, partials->Size(), &source);
+
+	OpenGLExecuter executer(context.UsesGpu());
+	executer.Run(&source, { partials.get(), const_cast<Operand*>(input) });
+
+	double result = 0;
+	for (int i = 0; i < partials->Size(); i++)
+		result += partials->data[i];
+
+	total.value = static_cast<float>(result);
+	total.Evaluate(context, operands);
+}
+
 void SumOp::Apply(Context& context, std::vector<Operand*>& operands) const {
-	std::string variable;
-	context.CreateOrGetGlobalVariable(&variable);
-	context.Swap();
-	context.AddBinOp("+");
-	context.CloseLoop();
+
+}
+
+// Partial sums are taken per tile and added in the tile order, so the result doesn't depend on the threads count
+void SumOp::Prepare(const KernelTable& kernels) const {
+	operand.Prepare(kernels);
+
+	int size = operand.Size();
+	std::vector<double> partials((size + NativeExecuter::TileSize - 1) / NativeExecuter::TileSize);
+
+	NativeExecuter::ForEachTile(size, [&](int offset, int count) {
+		float tile[NativeExecuter::TileSize];
+		const float* data = operand.Direct(offset);
+		if (data == nullptr) {
+			operand.Compute(kernels, offset, count, tile);
+			data = tile;
+		}
+
+		partials[offset / NativeExecuter::TileSize] = kernels.sum(data, count);
+	});
+
+	double total = 0;
+	for (double partial : partials)
+		total += partial;
+
+	sum = static_cast<float>(total);
+}
+
+void SumOp::Compute(const KernelTable& kernels, int offset, int count, float* out) const {
+	for (int i = 0; i < count; i++)
+		out[i] = sum;
+}
+
+const float* SumOp::Direct(int offset) const {
+	return nullptr;
+}
+
+bool SumOp::Elementwise() const {
+	return false;
+}
+
+Overlap SumOp::OverlapWith(const float* data, int size) const {
+	return Overlap::None;
+}
+
+// Inner elements reduced by one task when the reduced axis isn't the last one
+const int reduceInnerBlock = 1024;
+// Elements read by a task, smaller reductions aren't worth scheduling separately
+const int reduceMinimalTaskElements = 16384;
+
+ReduceOp::ReduceOp(const Operand& operand, Reduction reduction, int axis, bool keepDims) :
+	SingularOperation(operand, ReducedShape(operand.shape, axis, keepDims)), reduction(reduction), outer(1), axisSize(operand.shape.dimensionSizes[axis]), inner(1) {
+	for (int i = 0; i < axis; i++)
+		outer *= operand.shape.dimensionSizes[i];
+	for (int i = axis + 1; i < static_cast<int>(operand.shape.GetDimentionsCount()); i++)
+		inner *= operand.shape.dimensionSizes[i];
+
+	if (axisSize == 0)
+		throw "Reduced axis is empty";
+}
+
+Shape ReduceOp::ReducedShape(const Shape& shape, int axis, bool keepDims) {
+	if (axis < 0 || axis >= static_cast<int>(shape.GetDimentionsCount()))
+		throw "Axis is out of the operand dimensions";
+
+	std::vector<int> dimensions = shape.dimensionSizes;
+	if (keepDims)
+		dimensions[axis] = 1;
+	else
+		dimensions.erase(dimensions.begin() + axis);
+
+	// Whole vector reduced without keepDims is a single value
+	if (dimensions.empty())
+		dimensions.push_back(1);
+
+	return Shape(dimensions);
+}
+
+int ReduceOp::Size() const {
+	return shape.size;
+}
+
+bool ReduceOp::Elementwise() const {
+	return false;
+}
+
+Overlap ReduceOp::OverlapWith(const float* data, int size) const {
+	return Overlap::None;
+}
+
+void ReduceOp::Evaluate(Context& context, std::vector<Operand*>& operands) const {
+	PROFILE_SCOPE("ReduceOp OpenCL");
+
+	const Operand* input = &operand;
+	if (operand.GetData() == nullptr) {
+		if (materialized == nullptr)
+			materialized.reset(new Matrix(operand.shape, false));
+
+		operand.AssignTo(materialized.get(), context.UsesGpu() ? Backend::OpenCLGpu : Backend::OpenCLCpu);
+		input = materialized.get();
+	}
+
+	if (reduced == nullptr)
+		reduced.reset(new Matrix(shape, false));
+
+	std::string source;
+	GenerateKernel(reduction, outer, axisSize, inner, &source);
+
+	OpenGLExecuter executer(context.UsesGpu());
+	executer.Run(&source, { reduced.get(), const_cast<Operand*>(input) });
+
+	reduced->Evaluate(context, operands);
+}
+
+void ReduceOp::Apply(Context& context, std::vector<Operand*>& operands) const {
+
+}
+
+// Every work item reduces whole output elements, the sizes are literals like in the generated expression kernels
+void ReduceOp::GenerateKernel(Reduction reduction, int outer, int axisSize, int inner, std::string* output) {
+	std::string size = std::to_string(outer * inner);
+	std::string axis = std::to_string(axisSize);
+	std::string stride = std::to_string(inner);
+	std::string update;
+	std::string result = "acc";
+
+	switch (reduction) {
+	case Reduction::Sum:
+	case Reduction::Mean:
+		update = "acc += value;";
+		break;
+	case Reduction::Max:
+		update = "acc = fmax(acc, value);";
+		break;
+	case Reduction::Min:
+		update = "acc = fmin(acc, value);";
+		break;
+	case Reduction::ArgMax:
+		update = "if (value > acc) { acc = value; index = a; }";
+		result = "(float)index";
+		break;
+	}
+
+	if (reduction == Reduction::Mean)
+		result = "acc / " + axis + ".0f";
+
+	*output = "__kernel void executable(__global float* A_0, __global float* A_1){\n"
+		"for(int i = get_global_id(0); i < " + size + "; i += get_global_size(0))\n{\n"
+		"const int base = i / " + stride + " * " + std::to_string(axisSize * inner) + " + i % " + stride + ";\n"
+		"float acc = A_1[base];\n"
+		"int index = 0;\n"
+		"for(int a = 1; a < " + axis + "; a++)\n{\n"
+		"const float value = A_1[base + a * " + stride + "];\n" +
+		update + "\n"
+		"}\n"
+		"A_0[i] = " + result + ";\n"
+		"}\n"
+		"}";
+}
+
+void ReduceOp::Prepare(const KernelTable& kernels) const {
+	PROFILE_SCOPE("ReduceOp native");
+
+	operand.Prepare(kernels);
+
+	if (reduced == nullptr)
+		reduced.reset(new Matrix(shape, false));
+
+	reduceNative(kernels, materialize(kernels), reduced->data);
+}
+
+// Operands stored contiguously are reduced in place, others are computed tile by tile into a buffer
+const float* ReduceOp::materialize(const KernelTable& kernels) const {
+	const float* data = operand.Direct(0);
+	if (data != nullptr)
+		return data;
+
+	if (materialized == nullptr)
+		materialized.reset(new Matrix(operand.shape, false));
+
+	float* buffer = materialized->data;
+	NativeExecuter::ForEachTile(operand.Size(), [this, &kernels, buffer](int offset, int count) {
+		operand.Compute(kernels, offset, count, buffer + offset);
+	});
+
+	return buffer;
+}
+
+// Tasks are (outer index, block of inner elements) pairs. With the last axis reduced every output is
+// a contiguous row for the SIMD reductions, otherwise whole slices along the axis are combined elementwise
+void ReduceOp::reduceNative(const KernelTable& kernels, const float* in, float* out) const {
+	int blocks = (inner + reduceInnerBlock - 1) / reduceInnerBlock;
+	int grain = std::max(1, reduceMinimalTaskElements / (axisSize * std::min(inner, reduceInnerBlock)));
+
+	ThreadPool::Instance().ParallelFor(outer * blocks, [this, &kernels, in, out, blocks](int from, int to) {
+		std::vector<float> best;
+
+		for (int task = from; task < to; task++) {
+			int outerIndex = task / blocks;
+			int first = task % blocks * reduceInnerBlock;
+			int count = std::min(reduceInnerBlock, inner - first);
+			const float* slices = in + static_cast<std::size_t>(outerIndex) * axisSize * inner + first;
+			float* result = out + static_cast<std::size_t>(outerIndex) * inner + first;
+
+			if (inner == 1) {
+				switch (reduction) {
+				case Reduction::Sum:
+					*result = kernels.sum(slices, axisSize);
+					break;
+				case Reduction::Mean:
+					*result = kernels.sum(slices, axisSize) / axisSize;
+					break;
+				case Reduction::Max:
+					*result = kernels.max(slices, axisSize);
+					break;
+				case Reduction::Min:
+					*result = kernels.min(slices, axisSize);
+					break;
+				case Reduction::ArgMax:
+					*result = static_cast<float>(std::max_element(slices, slices + axisSize) - slices);
+					break;
+				}
+
+				continue;
+			}
+
+			if (reduction == Reduction::ArgMax) {
+				best.assign(slices, slices + count);
+				std::fill(result, result + count, 0.0f);
+			}
+			else {
+				std::memcpy(result, slices, count * sizeof(float));
+			}
+
+			for (int a = 1; a < axisSize; a++) {
+				const float* slice = slices + static_cast<std::size_t>(a) * inner;
+
+				switch (reduction) {
+				case Reduction::Sum:
+				case Reduction::Mean:
+					kernels.add(result, slice, result, count);
+					break;
+				case Reduction::Max:
+					for (int i = 0; i < count; i++)
+						result[i] = std::max(result[i], slice[i]);
+					break;
+				case Reduction::Min:
+					for (int i = 0; i < count; i++)
+						result[i] = std::min(result[i], slice[i]);
+					break;
+				case Reduction::ArgMax:
+					for (int i = 0; i < count; i++) {
+						if (slice[i] > best[i]) {
+							best[i] = slice[i];
+							result[i] = static_cast<float>(a);
+						}
+					}
+					break;
+				}
+			}
+
+			if (reduction == Reduction::Mean)
+				kernels.mulScalar(result, 1.0f / axisSize, result, count);
+		}
+	}, grain);
+}
+
+void ReduceOp::Compute(const KernelTable& kernels, int offset, int count, float* out) const {
+	std::memcpy(out, reduced->data + offset, count * sizeof(float));
+}
+
+const float* ReduceOp::Direct(int offset) const {
+	return reduced->data + offset;
 }
\ No newline at end of file
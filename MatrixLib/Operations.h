@@ -1,6 +1,9 @@
 #pragma once
 #include "Operand.h"
 #include "Context.h"
+#include "Matrix.h"
+#include "Constant.h"
+#include <memory>
 #include "Exportable.h"
 
 class STORING_ATTR OperationNode : public Operand
@@ -25,7 +28,15 @@ public:
 	~BinaryOperation() override;
 
 	void Evaluate(Context& context, std::vector<Operand*>& operands) const override;
+	void Prepare(const KernelTable& kernels) const override;
+	void Compute(const KernelTable& kernels, int offset, int count, float* out) const override;
 	int Size() const override;
+	bool Elementwise() const override;
+	Overlap OverlapWith(const float* data, int size) const override;
+
+protected:
+	virtual void ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const = 0;
+	virtual void ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const = 0;
 };
 
 class STORING_ATTR AdditionOp : public BinaryOperation
@@ -34,6 +45,10 @@ public:
 	AdditionOp(const Operand& leftOp, const Operand& rightOp);
 	AdditionOp(const Operand& leftOp, const float constant);
 	void Apply(Context& context, std::vector<Operand*>& operands) const override;
+
+protected:
+	void ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const override;
+	void ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const override;
 };
 
 class STORING_ATTR SubtractionOp : public BinaryOperation
@@ -43,6 +58,10 @@ public:
 	SubtractionOp(const Operand& leftOp, const float constant);
 	void Apply(Context& context, std::vector<Operand*>& operands) const override;
 
+protected:
+	void ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const override;
+	void ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const override;
+
 };
 
 class STORING_ATTR MultiplicationOp : public BinaryOperation
@@ -52,6 +71,10 @@ public:
 	MultiplicationOp(const Operand& leftOp, const float constant);
 	void Apply(Context& context, std::vector<Operand*>& operands) const override;
 
+protected:
+	void ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const override;
+	void ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const override;
+
 };
 
 //class STORING_ATTR MatrixMultiplicationOp : public BinaryOperation
@@ -69,17 +92,29 @@ public:
 	DivisionOp(const Operand& leftOp, const float constant);
 	void Apply(Context& context, std::vector<Operand*>& operands) const override;
 
+protected:
+	void ApplyNative(const KernelTable& kernels, const float* left, const float* right, float* out, int count) const override;
+	void ApplyNative(const KernelTable& kernels, const float* left, float constant, float* out, int count) const override;
+
 };
 
 class STORING_ATTR SingularOperation : public OperationNode
 {
 protected:
 	const Operand& operand;
+
+	SingularOperation(const Operand& operand, const Shape& shape);
 public:
 	SingularOperation(const Operand& operand);
 
 	void Evaluate(Context& context, std::vector<Operand*>& operands) const override;
+	void Prepare(const KernelTable& kernels) const override;
+	// Passes the operand through, the same as the generated kernels do
+	void Compute(const KernelTable& kernels, int offset, int count, float* out) const override;
+	const float* Direct(int offset) const override;
 	int Size() const override;
+	bool Elementwise() const override;
+	Overlap OverlapWith(const float* data, int size) const override;
 };
 
 class STORING_ATTR ElelmentsSumOp : public SingularOperation
@@ -98,10 +133,60 @@ public:
 
 };
 
+// The OpenCL backends reduce the operand with a kernel of its own before the expression kernel, which reads
+// the sum as a constant, so no work item of the expression loops over the whole operand
 class STORING_ATTR SumOp : public SingularOperation
 {
+	mutable float sum;
+	mutable Constant total;
+	mutable std::unique_ptr<Matrix> materialized;
+	mutable std::unique_ptr<Matrix> partials;
+
 public:
 	SumOp(const Operand& operand);
+	void Evaluate(Context& context, std::vector<Operand*>& operands) const override;
 	void Apply(Context& context, std::vector<Operand*>& operands) const override;
 
+	// Sum is reduced once in Prepare and broadcast to every tile
+	void Prepare(const KernelTable& kernels) const override;
+	void Compute(const KernelTable& kernels, int offset, int count, float* out) const override;
+	const float* Direct(int offset) const override;
+	bool Elementwise() const override;
+	// Operand is only read in Prepare, before any tile is written
+	Overlap OverlapWith(const float* data, int size) const override;
+
+};
+
+// Operand viewed as {outer, axis, inner}, the axis is reduced into {outer, inner}. The operand is materialized
+// first: the native backend reduces it in Prepare, the OpenCL backends run a reduction kernel while the
+// expression is evaluated and the generated kernel reads the result as a matrix
+class STORING_ATTR ReduceOp : public SingularOperation
+{
+	Reduction reduction;
+	int outer;
+	int axisSize;
+	int inner;
+
+	mutable std::unique_ptr<Matrix> materialized;
+	mutable std::unique_ptr<Matrix> reduced;
+
+public:
+	ReduceOp(const Operand& operand, Reduction reduction, int axis, bool keepDims = false);
+
+	void Evaluate(Context& context, std::vector<Operand*>& operands) const override;
+	void Apply(Context& context, std::vector<Operand*>& operands) const override;
+	void Prepare(const KernelTable& kernels) const override;
+	void Compute(const KernelTable& kernels, int offset, int count, float* out) const override;
+	const float* Direct(int offset) const override;
+	int Size() const override;
+	bool Elementwise() const override;
+	Overlap OverlapWith(const float* data, int size) const override;
+
+	static Shape ReducedShape(const Shape& shape, int axis, bool keepDims);
+	// OpenCL kernel reducing A_1 viewed as {outer, axisSize, inner} into A_0
+	static void GenerateKernel(Reduction reduction, int outer, int axisSize, int inner, std::string* output);
+
+private:
+	const float* materialize(const KernelTable& kernels) const;
+	void reduceNative(const KernelTable& kernels, const float* in, float* out) const;
 };
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+Profiler::Profiler() : deviceBuffer(std::make_shared<ThreadBuffer>()), origin(Now()) {
+	deviceBuffer->name = "OpenCL device";
+	deviceBuffer->id = 0;
+	deviceBuffer->depth = 0;
+}
+
+Profiler& Profiler::Instance() {
+	static Profiler profiler;
+	return profiler;
+}
+
+uint64_t Profiler::Now() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+Profiler::ThreadBuffer& Profiler::localBuffer() {
+	thread_local std::shared_ptr<ThreadBuffer> buffer;
+
+	if (!buffer) {
+		buffer = std::make_shared<ThreadBuffer>();
+		buffer->depth = 0;
+
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		buffer->id = static_cast<int>(buffers.size()) + 1;
+		buffer->name = "Thread " + std::to_string(buffer->id);
+		buffers.push_back(buffer);
+	}
+
+	return *buffer;
+}
+
+void Profiler::BeginZone() {
+	localBuffer().depth++;
+}
+
+void Profiler::EndZone(const char* name, uint64_t startNs) {
+	uint64_t end = Now();
+	ThreadBuffer& buffer = localBuffer();
+
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.depth--;
+	buffer.events.push_back(ProfileEvent{ name, startNs, end - startNs, buffer.depth });
+}
+
+void Profiler::RecordDevice(const char* name, uint64_t startNs, uint64_t endNs) {
+	std::lock_guard<std::mutex> lock(deviceBuffer->mutex);
+	deviceBuffer->events.push_back(ProfileEvent{ name, startNs, endNs - startNs, 0 });
+}
+
+std::map<std::string, ProfileStats> Profiler::Aggregate() {
+	std::map<std::string, ProfileStats> stats;
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	std::vector<std::shared_ptr<ThreadBuffer>> all(buffers);
+	all.push_back(deviceBuffer);
+
+	for (auto& buffer : all) {
+		std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+
+		for (const auto& event : buffer->events) {
+			auto inserted = stats.insert(std::make_pair(std::string(event.name), ProfileStats{ 0, 0, UINT64_MAX, 0 }));
+			ProfileStats& zone = inserted.first->second;
+
+			zone.count++;
+			zone.totalNs += event.durationNs;
+			zone.minNs = std::min(zone.minNs, event.durationNs);
+			zone.maxNs = std::max(zone.maxNs, event.durationNs);
+		}
+	}
+
+	return stats;
+}
+
+void Profiler::PrintStats(std::ostream& stream) {
+	auto stats = Aggregate();
+	std::vector<std::pair<std::string, ProfileStats>> sorted(stats.begin(), stats.end());
+
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, ProfileStats>& first, const std::pair<std::string, ProfileStats>& second) {
+		return first.second.totalNs > second.second.totalNs;
+	});
+
+	stream << std::left << std::setw(40) << "zone" << std::right << std::setw(10) << "count" << std::setw(14) << "total ms"
+		<< std::setw(12) << "mean us" << std::setw(12) << "min us" << std::setw(12) << "max us" << "\n";
+
+	for (const auto& zone : sorted) {
+		stream << std::left << std::setw(40) << zone.first << std::right << std::setw(10) << zone.second.count
+			<< std::setw(14) << std::fixed << std::setprecision(3) << zone.second.totalNs * 1e-6
+			<< std::setw(12) << zone.second.MeanNs() * 1e-3
+			<< std::setw(12) << zone.second.minNs * 1e-3
+			<< std::setw(12) << zone.second.maxNs * 1e-3 << "\n";
+	}
+}
+
+std::string escapeJson(const std::string& text) {
+	std::string escaped;
+
+	for (char symbol : text) {
+		if (symbol == '"' || symbol == '\\')
+			escaped += '\\';
+		escaped += symbol;
+	}
+
+	return escaped;
+}
+
+// Chrome trace event format, can be opened in chrome://tracing or Perfetto UI
+void Profiler::ExportChromeTrace(const std::string& path) {
+	std::ofstream file(path);
+	if (!file)
+		throw "Can't create trace file";
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	std::vector<std::shared_ptr<ThreadBuffer>> all(buffers);
+	all.push_back(deviceBuffer);
+
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	file << std::fixed << std::setprecision(3);
+	bool first = true;
+
+	for (auto& buffer : all) {
+		std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+		const char* category = buffer == deviceBuffer ? "device" : "host";
+
+		file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->id
+			<< ", \"args\": {\"name\": \"" << escapeJson(buffer->name) << "\"}}";
+		first = false;
+
+		for (const auto& event : buffer->events) {
+			// Device timestamps may precede the origin slightly after the clock conversion
+			double start = (static_cast<double>(event.startNs) - static_cast<double>(origin)) * 1e-3;
+
+			file << ",\n{\"name\": \"" << escapeJson(event.name) << "\", \"cat\": \"" << category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->id
+				<< ", \"ts\": " << start << ", \"dur\": " << event.durationNs * 1e-3 << ", \"args\": {\"depth\": " << event.depth << "}}";
+		}
+	}
+
+	file << "\n]}\n";
+}
+
+void Profiler::Clear() {
+	std::lock_guard<std::mutex> lock(buffersMutex);
+
+	for (auto& buffer : buffers) {
+		std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+		buffer->events.clear();
+	}
+
+	std::lock_guard<std::mutex> deviceLock(deviceBuffer->mutex);
+	deviceBuffer->events.clear();
+}
+
+ProfileZone::ProfileZone(const char* name) : name(name) {
+	Profiler::Instance().BeginZone();
+	start = Profiler::Now();
+}
+
+ProfileZone::~ProfileZone() {
+	Profiler::Instance().EndZone(name, start);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "Exportable.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Zones are recorded only when MATRIXLIB_PROFILING is defined, otherwise the macros expand to nothing
+#ifdef MATRIXLIB_PROFILING
+#define PROFILE_CONCAT_IMPL(first, second) first##second
+#define PROFILE_CONCAT(first, second) PROFILE_CONCAT_IMPL(first, second)
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#endif
+
+struct STORING_ATTR ProfileEvent {
+	// Names must outlive the profiler, string literals are expected
+	const char* name;
+	uint64_t startNs;
+	uint64_t durationNs;
+	int depth;
+};
+
+struct STORING_ATTR ProfileStats {
+	uint64_t count;
+	uint64_t totalNs;
+	uint64_t minNs;
+	uint64_t maxNs;
+
+	inline double MeanNs() const { return count == 0 ? 0 : static_cast<double>(totalNs) / count; }
+};
+
+class STORING_ATTR Profiler {
+	struct ThreadBuffer {
+		std::mutex mutex;
+		std::vector<ProfileEvent> events;
+		std::string name;
+		int id;
+		int depth;
+	};
+
+	std::mutex buffersMutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	std::shared_ptr<ThreadBuffer> deviceBuffer;
+	uint64_t origin;
+
+public:
+	static Profiler& Instance();
+	static uint64_t Now();
+
+	// Zones nest by time, depth is tracked per thread to tell nested zones apart in the trace
+	void BeginZone();
+	void EndZone(const char* name, uint64_t startNs);
+	// Device zones come from OpenCL event timestamps already converted to the host clock
+	void RecordDevice(const char* name, uint64_t startNs, uint64_t endNs);
+
+	std::map<std::string, ProfileStats> Aggregate();
+	void PrintStats(std::ostream& stream);
+	void ExportChromeTrace(const std::string& path);
+	void Clear();
+
+private:
+	Profiler();
+	ThreadBuffer& localBuffer();
+};
+
+class STORING_ATTR ProfileZone {
+	const char* name;
+	uint64_t start;
+
+public:
+	ProfileZone(const char* name);
+	~ProfileZone();
+};
@@ -0,0 +1,164 @@
+#include "Random.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+const std::uint32_t philoxMultiplier0 = 0xD2511F53u;
+const std::uint32_t philoxMultiplier1 = 0xCD9E8D57u;
+const std::uint32_t philoxWeyl0 = 0x9E3779B9u;
+const std::uint32_t philoxWeyl1 = 0xBB67AE85u;
+const int philoxRounds = 10;
+// Elements generated by one task of the fills
+const int fillGrain = 1 << 14;
+const float twoPi = 6.28318530717958647f;
+
+// 24 high bits to [0, 1), the offset variant gives (0, 1] for the logarithm of Box-Muller
+inline float toUnit(std::uint32_t value) {
+	return (value >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float toUnitNonZero(std::uint32_t value) {
+	return ((value >> 8) + 1) * (1.0f / 16777216.0f);
+}
+
+void fillParallel(Matrix& matrix, const std::function<void(float* out, std::int64_t offset, int count)>& fill) {
+	float* data = matrix.data;
+	int size = matrix.shape.size;
+
+	ThreadPool::Instance().ParallelFor((size + fillGrain - 1) / fillGrain, [data, size, &fill](int from, int to) {
+		for (int chunk = from; chunk < to; chunk++) {
+			int offset = chunk * fillGrain;
+			fill(data + offset, offset, std::min(fillGrain, size - offset));
+		}
+	});
+}
+
+Random::Random(std::uint64_t seed, std::uint64_t tensorId) : seed(seed), tensorId(tensorId) {}
+
+void Random::Block(const std::uint32_t counter[4], const std::uint32_t key[2], std::uint32_t out[4]) {
+	std::uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	std::uint32_t k0 = key[0], k1 = key[1];
+
+	for (int round = 0; round < philoxRounds; round++) {
+		std::uint64_t product0 = static_cast<std::uint64_t>(philoxMultiplier0) * c0;
+		std::uint64_t product1 = static_cast<std::uint64_t>(philoxMultiplier1) * c2;
+
+		c0 = static_cast<std::uint32_t>(product1 >> 32) ^ c1 ^ k0;
+		c1 = static_cast<std::uint32_t>(product1);
+		c2 = static_cast<std::uint32_t>(product0 >> 32) ^ c3 ^ k1;
+		c3 = static_cast<std::uint32_t>(product0);
+
+		k0 += philoxWeyl0;
+		k1 += philoxWeyl1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+// Counter is (block index, tensor id), the key is the seed
+void Random::block(std::int64_t index, std::uint32_t out[4]) const {
+	std::uint64_t position = static_cast<std::uint64_t>(index);
+	std::uint32_t counter[4] = {
+		static_cast<std::uint32_t>(position), static_cast<std::uint32_t>(position >> 32),
+		static_cast<std::uint32_t>(tensorId), static_cast<std::uint32_t>(tensorId >> 32)
+	};
+	std::uint32_t key[2] = { static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) };
+
+	Block(counter, key, out);
+}
+
+// Calls generate(block index, values[4]) for the blocks covering the region, whole blocks are written in place
+template<typename Generate>
+void generateRegion(float* out, std::int64_t offset, int count, Generate generate) {
+	float values[4];
+	std::int64_t end = offset + count;
+	std::int64_t element = offset;
+
+	while (element < end && (element % 4 != 0 || end - element < 4)) {
+		generate(element / 4, values);
+		do {
+			out[element - offset] = values[element % 4];
+			element++;
+		} while (element < end && element % 4 != 0);
+	}
+
+	for (; end - element >= 4; element += 4)
+		generate(element / 4, out + (element - offset));
+
+	if (element < end) {
+		generate(element / 4, values);
+		for (; element < end; element++)
+			out[element - offset] = values[element % 4];
+	}
+}
+
+void Random::Uniform(float* out, std::int64_t offset, int count, float low, float high) const {
+	float range = high - low;
+
+	generateRegion(out, offset, count, [this, low, range](std::int64_t index, float* values) {
+		std::uint32_t bits[4];
+		block(index, bits);
+		for (int lane = 0; lane < 4; lane++)
+			values[lane] = low + range * toUnit(bits[lane]);
+	});
+}
+
+// Lanes 0, 1 and lanes 2, 3 of a block are two Box-Muller pairs, so an element doesn't depend on the region start
+void Random::Normal(float* out, std::int64_t offset, int count, float mean, float stddev) const {
+	generateRegion(out, offset, count, [this, mean, stddev](std::int64_t index, float* values) {
+		std::uint32_t bits[4];
+		block(index, bits);
+
+		for (int pair = 0; pair < 2; pair++) {
+			float radius = stddev * std::sqrt(-2.0f * std::log(toUnitNonZero(bits[2 * pair])));
+			float angle = twoPi * toUnit(bits[2 * pair + 1]);
+			values[2 * pair] = mean + radius * std::cos(angle);
+			values[2 * pair + 1] = mean + radius * std::sin(angle);
+		}
+	});
+}
+
+void Random::Bernoulli(float* out, std::int64_t offset, int count, float probability, float value) const {
+	generateRegion(out, offset, count, [this, probability, value](std::int64_t index, float* values) {
+		std::uint32_t bits[4];
+		block(index, bits);
+		for (int lane = 0; lane < 4; lane++)
+			values[lane] = toUnit(bits[lane]) < probability ? value : 0.0f;
+	});
+}
+
+void Random::FillUniform(Matrix& matrix, float low, float high) const {
+	PROFILE_SCOPE("Random::FillUniform");
+
+	fillParallel(matrix, [this, low, high](float* out, std::int64_t offset, int count) {
+		Uniform(out, offset, count, low, high);
+	});
+}
+
+void Random::FillNormal(Matrix& matrix, float mean, float stddev) const {
+	PROFILE_SCOPE("Random::FillNormal");
+
+	fillParallel(matrix, [this, mean, stddev](float* out, std::int64_t offset, int count) {
+		Normal(out, offset, count, mean, stddev);
+	});
+}
+
+void Random::FillBernoulli(Matrix& matrix, float probability, float value) const {
+	PROFILE_SCOPE("Random::FillBernoulli");
+
+	fillParallel(matrix, [this, probability, value](float* out, std::int64_t offset, int count) {
+		Bernoulli(out, offset, count, probability, value);
+	});
+}
+
+void Random::FillScaled(Matrix& matrix, int fanIn) const {
+	if (fanIn <= 0)
+		throw "Fan in must be positive";
+
+	FillNormal(matrix, 0.0f, 1.0f / std::sqrt(static_cast<float>(fanIn)));
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+#include "Matrix.h"
+#include "Exportable.h"
+#include <cstdint>
+
+// Counter based generator (Philox4x32-10): element i of a tensor is a pure function of (seed, tensorId, i),
+// so any region can be generated on its own, by any thread and in any order, with the same values.
+// Every block of 4 elements costs one Philox evaluation, normals take two of its outputs per pair (Box-Muller)
+class STORING_ATTR Random {
+	std::uint64_t seed;
+	std::uint64_t tensorId;
+
+public:
+	Random(std::uint64_t seed, std::uint64_t tensorId);
+
+	// Philox4x32-10 of the 128 bit counter under the 64 bit key
+	static void Block(const std::uint32_t counter[4], const std::uint32_t key[2], std::uint32_t out[4]);
+
+	// Elements [offset, offset + count) of the tensor's sequence into out[0, count)
+	void Uniform(float* out, std::int64_t offset, int count, float low = 0.0f, float high = 1.0f) const;
+	void Normal(float* out, std::int64_t offset, int count, float mean = 0.0f, float stddev = 1.0f) const;
+	// value with the probability, 0 otherwise (e.g. an inverted dropout mask with value 1 / probability)
+	void Bernoulli(float* out, std::int64_t offset, int count, float probability, float value = 1.0f) const;
+
+	// Whole matrix on the thread pool, the result doesn't depend on the threads count
+	void FillUniform(Matrix& matrix, float low = 0.0f, float high = 1.0f) const;
+	void FillNormal(Matrix& matrix, float mean = 0.0f, float stddev = 1.0f) const;
+	void FillBernoulli(Matrix& matrix, float probability, float value = 1.0f) const;
+	// Normal with 1 / sqrt(fanIn) deviation, the initialization of a layer with fanIn inputs per neuron
+	void FillScaled(Matrix& matrix, int fanIn) const;
+
+private:
+	void block(std::int64_t index, std::uint32_t out[4]) const;
+};
\ No newline at end of file
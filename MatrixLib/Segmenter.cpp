@@ -0,0 +1,292 @@
+#include "Segmenter.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+Segmenter::Segmenter(float threshold, int minimalArea, int lineThreshold, int cropSize, int fitSize) :
+	threshold(threshold), minimalArea(minimalArea), lineThreshold(lineThreshold), cropSize(cropSize), fitSize(fitSize) {
+	threadsCount = ThreadPool::Instance().ThreadsCount();
+}
+
+// Runs function(i) for every i in [0, count) on the library thread pool
+template<typename Function>
+void Segmenter::parallelFor(int count, Function function) const {
+	ThreadPool::Instance().ParallelFor(count, [&function](int from, int to) {
+		for (int i = from; i < to; i++)
+			function(i);
+	});
+}
+
+inline int findRoot(const int* parent, int element) {
+	while (parent[element] != element)
+		element = parent[element];
+
+	return element;
+}
+
+inline int findRootHalving(int* parent, int element) {
+	while (parent[element] != element) {
+		parent[element] = parent[parent[element]];
+		element = parent[element];
+	}
+
+	return element;
+}
+
+// Smaller index always becomes the root, so the result doesn't depend on the merge order
+inline void unite(int* parent, int first, int second) {
+	first = findRootHalving(parent, first);
+	second = findRootHalving(parent, second);
+
+	if (first < second)
+		parent[second] = first;
+	else if (second < first)
+		parent[first] = second;
+}
+
+Matrix* Segmenter::Process(const Matrix& image, std::vector<BoundingBox>* boxesOut) const {
+	PROFILE_SCOPE("Segmenter::Process");
+
+	std::vector<int> labels;
+	std::vector<BoundingBox> components;
+	Label(image, &labels, &components);
+
+	std::vector<BoundingBox> boxes;
+	std::vector<int> order;
+	for (std::size_t i = 0; i < components.size(); i++) {
+		if (components[i].Width() * components[i].Height() > minimalArea) {
+			boxes.push_back(components[i]);
+			order.push_back(static_cast<int>(i) + 1);
+		}
+	}
+
+	sortInReadingOrder(boxes, order);
+
+	int count = static_cast<int>(boxes.size());
+	int height = image.shape.dimensionSizes[0];
+	int width = image.shape.dimensionSizes[1];
+	Matrix* crops = new Matrix(Shape(std::vector<int>{ count, cropSize, cropSize }), false);
+
+	parallelFor(count, [&](int i) {
+		crop(image.data, labels.data(), width, height, order[i], boxes[i], crops->data + i * cropSize * cropSize);
+	});
+
+	if (boxesOut != nullptr)
+		*boxesOut = boxes;
+
+	return crops;
+}
+
+// Labels 8-connected components, labels are 1-based (0 is background) and index boxesOut with label - 1
+void Segmenter::Label(const Matrix& image, std::vector<int>* labelsOut, std::vector<BoundingBox>* boxesOut) const {
+	if (image.shape.GetDimentionsCount() != 2)
+		throw "Image must have {height, width} shape";
+
+	int height = image.shape.dimensionSizes[0];
+	int width = image.shape.dimensionSizes[1];
+	int size = height * width;
+	const float* data = image.data;
+
+	std::vector<int> parent(size, -1);
+	int stripes = std::max(1, std::min(threadsCount, height));
+	int stripeHeight = (height + stripes - 1) / stripes;
+
+	// Every stripe is labeled independently, unions never cross stripe borders here
+	parallelFor(stripes, [&](int stripe) {
+		labelStripe(data, parent.data(), width, stripe * stripeHeight, std::min(height, (stripe + 1) * stripeHeight));
+	});
+
+	for (int row = stripeHeight; row < height; row += stripeHeight) {
+		for (int x = 0; x < width; x++) {
+			int element = row * width + x;
+			if (parent[element] < 0)
+				continue;
+
+			for (int dx = -1; dx <= 1; dx++) {
+				int neighbourX = x + dx;
+				if (neighbourX >= 0 && neighbourX < width && parent[element - width + dx] >= 0)
+					unite(parent.data(), element, element - width + dx);
+			}
+		}
+	}
+
+	std::vector<int>& labels = *labelsOut;
+	labels.assign(size, 0);
+
+	parallelFor(stripes, [&](int stripe) {
+		int to = std::min(height, (stripe + 1) * stripeHeight) * width;
+		for (int i = stripe * stripeHeight * width; i < to; i++)
+			labels[i] = parent[i] < 0 ? -1 : findRoot(parent.data(), i);
+	});
+
+	// Roots are the smallest pixel index of their component, so one pass assigns labels in the raster order
+	int components = 0;
+	for (int i = 0; i < size; i++) {
+		if (labels[i] == i)
+			parent[i] = ++components;
+	}
+
+	parallelFor(stripes, [&](int stripe) {
+		int to = std::min(height, (stripe + 1) * stripeHeight) * width;
+		for (int i = stripe * stripeHeight * width; i < to; i++)
+			labels[i] = labels[i] < 0 ? 0 : parent[labels[i]];
+	});
+
+	std::vector<std::vector<BoundingBox>> partial(stripes, std::vector<BoundingBox>(components, BoundingBox{ INT_MAX, INT_MAX, -1, -1, 0, 0, 0 }));
+
+	parallelFor(stripes, [&](int stripe) {
+		measureStripe(data, labels.data(), width, stripe * stripeHeight, std::min(height, (stripe + 1) * stripeHeight), &partial[stripe]);
+	});
+
+	std::vector<BoundingBox>& boxes = *boxesOut;
+	boxes = partial[0];
+
+	for (int stripe = 1; stripe < stripes; stripe++) {
+		for (int i = 0; i < components; i++) {
+			const BoundingBox& other = partial[stripe][i];
+			BoundingBox& box = boxes[i];
+
+			box.left = std::min(box.left, other.left);
+			box.top = std::min(box.top, other.top);
+			box.right = std::max(box.right, other.right);
+			box.bottom = std::max(box.bottom, other.bottom);
+			box.mass += other.mass;
+			box.centerX += other.centerX;
+			box.centerY += other.centerY;
+		}
+	}
+
+	for (auto& box : boxes) {
+		if (box.mass > 0) {
+			box.centerX /= box.mass;
+			box.centerY /= box.mass;
+		}
+	}
+}
+
+void Segmenter::labelStripe(const float* image, int* parent, int width, int fromRow, int toRow) const {
+	for (int y = fromRow; y < toRow; y++) {
+		for (int x = 0; x < width; x++) {
+			int element = y * width + x;
+			if (image[element] <= threshold)
+				continue;
+
+			parent[element] = element;
+
+			if (x > 0 && parent[element - 1] >= 0)
+				unite(parent, element, element - 1);
+
+			if (y == fromRow)
+				continue;
+
+			for (int dx = -1; dx <= 1; dx++) {
+				int neighbourX = x + dx;
+				if (neighbourX >= 0 && neighbourX < width && parent[element - width + dx] >= 0)
+					unite(parent, element, element - width + dx);
+			}
+		}
+	}
+}
+
+// Centers are accumulated as intensity weighted sums and normalized after all stripes are merged
+void Segmenter::measureStripe(const float* image, const int* labels, int width, int fromRow, int toRow, std::vector<BoundingBox>* boxes) const {
+	for (int y = fromRow; y < toRow; y++) {
+		for (int x = 0; x < width; x++) {
+			int label = labels[y * width + x];
+			if (label == 0)
+				continue;
+
+			BoundingBox& box = (*boxes)[label - 1];
+			float value = image[y * width + x];
+
+			box.left = std::min(box.left, x);
+			box.top = std::min(box.top, y);
+			box.right = std::max(box.right, x);
+			box.bottom = std::max(box.bottom, y);
+			box.mass += value;
+			box.centerX += value * x;
+			box.centerY += value * y;
+		}
+	}
+}
+
+// Boxes which tops are closer than lineThreshold form one line, lines are read from left to right
+void Segmenter::sortInReadingOrder(std::vector<BoundingBox>& boxes, std::vector<int>& order) const {
+	std::vector<int> indexes(boxes.size());
+	for (std::size_t i = 0; i < indexes.size(); i++)
+		indexes[i] = static_cast<int>(i);
+
+	std::sort(indexes.begin(), indexes.end(), [&](int first, int second) {
+		return boxes[first].top < boxes[second].top;
+	});
+
+	std::vector<int> lines(boxes.size());
+	int line = 0;
+	int lineTop = indexes.empty() ? 0 : boxes[indexes[0]].top;
+
+	for (int index : indexes) {
+		if (boxes[index].top - lineTop > lineThreshold) {
+			line++;
+			lineTop = boxes[index].top;
+		}
+
+		lines[index] = line;
+	}
+
+	std::stable_sort(indexes.begin(), indexes.end(), [&](int first, int second) {
+		if (lines[first] != lines[second])
+			return lines[first] < lines[second];
+
+		return boxes[first].left < boxes[second].left;
+	});
+
+	std::vector<BoundingBox> sortedBoxes;
+	std::vector<int> sortedOrder;
+	for (int index : indexes) {
+		sortedBoxes.push_back(boxes[index]);
+		sortedOrder.push_back(order[index]);
+	}
+
+	boxes.swap(sortedBoxes);
+	order.swap(sortedOrder);
+}
+
+// Scales the component so its longest side fits fitSize and puts its center of mass in the crop center.
+// Every crop pixel is the area average of the source pixels it covers, other components are masked out
+void Segmenter::crop(const float* image, const int* labels, int width, int height, int label, const BoundingBox& box, float* out) const {
+	float scale = static_cast<float>(fitSize) / std::max(box.Width(), box.Height());
+	float footprint = 1 / scale;
+	float center = cropSize * 0.5f;
+
+	for (int y = 0; y < cropSize; y++) {
+		float top = (y - center) * footprint + box.centerY + 0.5f;
+		float bottom = top + footprint;
+		int firstRow = std::max(static_cast<int>(std::floor(top)), box.top);
+		int lastRow = std::min(static_cast<int>(std::ceil(bottom)) - 1, box.bottom);
+
+		for (int x = 0; x < cropSize; x++) {
+			float left = (x - center) * footprint + box.centerX + 0.5f;
+			float right = left + footprint;
+			int firstColumn = std::max(static_cast<int>(std::floor(left)), box.left);
+			int lastColumn = std::min(static_cast<int>(std::ceil(right)) - 1, box.right);
+			float value = 0;
+
+			for (int row = firstRow; row <= lastRow; row++) {
+				float coverY = std::min(bottom, row + 1.0f) - std::max(top, static_cast<float>(row));
+
+				for (int column = firstColumn; column <= lastColumn; column++) {
+					int element = row * width + column;
+					if (labels[element] != label)
+						continue;
+
+					float coverX = std::min(right, column + 1.0f) - std::max(left, static_cast<float>(column));
+					value += coverX * coverY * image[element];
+				}
+			}
+
+			out[y * cropSize + x] = std::min(1.0f, value * scale * scale);
+		}
+	}
+}
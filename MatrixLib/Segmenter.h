@@ -0,0 +1,45 @@
+#pragma once
+#include "Matrix.h"
+#include "Exportable.h"
+#include <vector>
+
+struct STORING_ATTR BoundingBox {
+	// Inclusive borders in image pixels
+	int left;
+	int top;
+	int right;
+	int bottom;
+	// Sum of the component intensities and its center of mass
+	float mass;
+	float centerX;
+	float centerY;
+
+	inline int Width() const { return right - left + 1; }
+	inline int Height() const { return bottom - top + 1; }
+};
+
+// Splits an image with several drawn symbols into normalized crops that can be evaluated as one batch
+class STORING_ATTR Segmenter {
+	float threshold;
+	int minimalArea;
+	int lineThreshold;
+	int cropSize;
+	int fitSize;
+	int threadsCount;
+
+public:
+	Segmenter(float threshold = 0.4f, int minimalArea = 100, int lineThreshold = 50, int cropSize = 28, int fitSize = 20);
+
+	// Image must have {height, width} shape with ink values above the threshold.
+	// Returns {count, cropSize, cropSize} tensor, crops follow the reading order of the boxes
+	Matrix* Process(const Matrix& image, std::vector<BoundingBox>* boxesOut) const;
+	void Label(const Matrix& image, std::vector<int>* labelsOut, std::vector<BoundingBox>* boxesOut) const;
+
+private:
+	void labelStripe(const float* image, int* parent, int width, int fromRow, int toRow) const;
+	void measureStripe(const float* image, const int* labels, int width, int fromRow, int toRow, std::vector<BoundingBox>* boxes) const;
+	void sortInReadingOrder(std::vector<BoundingBox>& boxes, std::vector<int>& order) const;
+	void crop(const float* image, const int* labels, int width, int height, int label, const BoundingBox& box, float* out) const;
+	template<typename Function>
+	void parallelFor(int count, Function function) const;
+};
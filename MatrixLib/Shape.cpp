@@ -1,12 +1,18 @@
 #include "Shape.h"
+#include <climits>
+#include <cstdint>
 
-Shape::Shape(std::vector<int>& dimensionSizes) : dimensionSizes(dimensionSizes), size(Size()) {}
-Shape::Shape() : dimensionSizes(std::vector<int>()), size(0) {}
+Shape::Shape(const std::vector<int>& dimensionSizes) : dimensionSizes(dimensionSizes), size(Size()) {}
+Shape::Shape() : dimensionSizes(), size(0) {}
+// Element counts and offsets of the operands are ints, larger tensors are refused instead of wrapping around
 int Shape::Size() const {
-	int size = 1;
+	int64_t size = 1;
 
-	for (std::size_t i = 0; i < dimensionSizes.size(); i++)
+	for (std::size_t i = 0; i < dimensionSizes.size(); i++) {
 		size *= dimensionSizes[i];
+		if (size > INT_MAX || size < -static_cast<int64_t>(INT_MAX))
+			throw "Tensor has more than 2^31 - 1 elements";
+	}
 
-	return size;
+	return static_cast<int>(size);
 }
@@ -5,10 +5,10 @@
 struct STORING_ATTR Shape
 {
 public:
-	const std::vector<int>& dimensionSizes;
+	const std::vector<int> dimensionSizes;
 	const int size;
 
-	Shape(std::vector<int>& dimensionSizes);
+	Shape(const std::vector<int>& dimensionSizes);
 	Shape();
 	inline std::size_t GetDimentionsCount() const { return dimensionSizes.size(); }
 	inline bool Compare(const Shape& other) const { return other.dimensionSizes == dimensionSizes; }
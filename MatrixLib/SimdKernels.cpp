@@ -0,0 +1,26 @@
+#include "SimdKernels.h"
+
+const KernelTable& scalarKernels();
+const KernelTable& sse42Kernels();
+const KernelTable& avx2Kernels();
+const KernelTable& avx512Kernels();
+
+const KernelTable& Kernels() {
+	return KernelsFor(CpuFeatures::Active());
+}
+
+const KernelTable& KernelsFor(IsaLevel level) {
+	if (level > CpuFeatures::Detect())
+		throw "Instruction set is not supported by this CPU";
+
+	switch (level) {
+	case IsaLevel::SSE42:
+		return sse42Kernels();
+	case IsaLevel::AVX2:
+		return avx2Kernels();
+	case IsaLevel::AVX512:
+		return avx512Kernels();
+	default:
+		return scalarKernels();
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "CpuFeatures.h"
+#include "Exportable.h"
+
+// Hand vectorized kernels compiled once per instruction set level, Kernels() returns the table of the active level.
+// Arrays don't need any alignment, matrices are row-major with leading dimensions in elements
+struct STORING_ATTR KernelTable {
+	IsaLevel level;
+
+	// out[i] = a[i] op b[i], out may alias the inputs
+	void (*add)(const float* a, const float* b, float* out, int count);
+	void (*sub)(const float* a, const float* b, float* out, int count);
+	void (*mul)(const float* a, const float* b, float* out, int count);
+	void (*div)(const float* a, const float* b, float* out, int count);
+
+	// out[i] = a[i] op value
+	void (*addScalar)(const float* a, float value, float* out, int count);
+	void (*subScalar)(const float* a, float value, float* out, int count);
+	void (*mulScalar)(const float* a, float value, float* out, int count);
+	void (*divScalar)(const float* a, float value, float* out, int count);
+
+	// out[i] = a[i] * b[i] + c[i] and out[i] = a[i] * value + b[i]
+	void (*multiplyAdd)(const float* a, const float* b, const float* c, float* out, int count);
+	void (*scaleAdd)(const float* a, float value, const float* b, float* out, int count);
+
+	float (*sum)(const float* a, int count);
+	float (*max)(const float* a, int count);
+	float (*min)(const float* a, int count);
+	float (*dot)(const float* a, const float* b, int count);
+
+	void (*relu)(const float* a, float* out, int count);
+	void (*sigmoid)(const float* a, float* out, int count);
+	void (*tanh)(const float* a, float* out, int count);
+	void (*exp)(const float* a, float* out, int count);
+
+	// c[m x n] += a[m x k] * b[k x n]
+	void (*gemm)(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc);
+	// c[n] += sum of values[p] * b[indices[p]][0..n), one CSR row times a dense matrix
+	void (*sparseRow)(const float* values, const int* indices, int nonZeros, const float* b, int ldb, float* c, int n);
+};
+
+STORING_ATTR const KernelTable& Kernels();
+// Throws when the level isn't supported by the CPU
+STORING_ATTR const KernelTable& KernelsFor(IsaLevel level);
@@ -0,0 +1,76 @@
+#include "SimdKernels.h"
+
+const KernelTable& scalarKernels();
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// MSVC gets /arch:AVX2 for this file from the project
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2,fma")
+#endif
+
+#include "SimdKernelsImpl.h"
+
+namespace {
+
+	struct Avx2Traits {
+		typedef __m256 reg;
+		static const int width = 8;
+
+		static inline reg load(const float* address) { return _mm256_loadu_ps(address); }
+		static inline void store(float* address, reg value) { _mm256_storeu_ps(address, value); }
+		static inline reg set1(float value) { return _mm256_set1_ps(value); }
+		static inline reg zero() { return _mm256_setzero_ps(); }
+		static inline reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+		static inline reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+		static inline reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+		static inline reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+		static inline reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+		static inline reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+		static inline reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+		static inline reg floor(reg a) { return _mm256_floor_ps(a); }
+
+		static inline reg pow2n(reg n) {
+			__m256i exponent = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+			return _mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23));
+		}
+
+		static inline float hsum(reg a) {
+			__m128 quad = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+			__m128 pairs = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+			return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+
+		static inline float hmax(reg a) {
+			__m128 quad = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+			__m128 pairs = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+			return _mm_cvtss_f32(_mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+
+		static inline float hmin(reg a) {
+			__m128 quad = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+			__m128 pairs = _mm_min_ps(quad, _mm_movehl_ps(quad, quad));
+			return _mm_cvtss_f32(_mm_min_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+	};
+}
+
+const KernelTable& avx2Kernels() {
+	static const KernelTable table = simd::createTable<Avx2Traits>(IsaLevel::AVX2);
+	return table;
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+const KernelTable& avx2Kernels() {
+	return scalarKernels();
+}
+
+#endif
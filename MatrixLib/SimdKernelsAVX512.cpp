@@ -0,0 +1,62 @@
+#include "SimdKernels.h"
+
+const KernelTable& scalarKernels();
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// MSVC gets /arch:AVX512 for this file from the project
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f,avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx512f,avx2,fma")
+#endif
+
+#include "SimdKernelsImpl.h"
+
+namespace {
+
+	struct Avx512Traits {
+		typedef __m512 reg;
+		static const int width = 16;
+
+		static inline reg load(const float* address) { return _mm512_loadu_ps(address); }
+		static inline void store(float* address, reg value) { _mm512_storeu_ps(address, value); }
+		static inline reg set1(float value) { return _mm512_set1_ps(value); }
+		static inline reg zero() { return _mm512_setzero_ps(); }
+		static inline reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+		static inline reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+		static inline reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+		static inline reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+		static inline reg max(reg a, reg b) { return _mm512_max_ps(a, b); }
+		static inline reg min(reg a, reg b) { return _mm512_min_ps(a, b); }
+		static inline reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+		static inline reg floor(reg a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+		static inline reg pow2n(reg n) {
+			__m512i exponent = _mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127));
+			return _mm512_castsi512_ps(_mm512_slli_epi32(exponent, 23));
+		}
+
+		static inline float hsum(reg a) { return _mm512_reduce_add_ps(a); }
+		static inline float hmax(reg a) { return _mm512_reduce_max_ps(a); }
+		static inline float hmin(reg a) { return _mm512_reduce_min_ps(a); }
+	};
+}
+
+const KernelTable& avx512Kernels() {
+	static const KernelTable table = simd::createTable<Avx512Traits>(IsaLevel::AVX512);
+	return table;
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+const KernelTable& avx512Kernels() {
+	return scalarKernels();
+}
+
+#endif
@@ -0,0 +1,348 @@
+#pragma once
+#include "SimdKernels.h"
+
+// Kernel templates shared by the SimdKernels*.cpp files. Every file instantiates them with its own
+// translation unit local register traits (V) under its own target options, so the instantiations never merge.
+// V provides: reg, width, load, store, set1, zero, add, sub, mul, div, max, min, fmadd, floor, pow2n, hsum, hmax, hmin.
+// Only plain loops are used here, standard library templates instantiated under the target options could
+// be picked by the linker for the other levels
+
+namespace simd {
+
+	template<typename V>
+	inline typename V::reg exp(typename V::reg x) {
+		typedef typename V::reg reg;
+
+		x = V::min(V::max(x, V::set1(-87.3f)), V::set1(88.3f));
+
+		// x = n * ln2 + r, exp(x) = 2^n * exp(r) with exp(r) approximated by a polynomial on [-ln2/2, ln2/2]
+		reg n = V::floor(V::fmadd(x, V::set1(1.44269504088896341f), V::set1(0.5f)));
+		reg r = V::sub(x, V::mul(n, V::set1(0.693359375f)));
+		r = V::sub(r, V::mul(n, V::set1(-2.12194440e-4f)));
+
+		reg y = V::set1(1.9875691500e-4f);
+		y = V::fmadd(y, r, V::set1(1.3981999507e-3f));
+		y = V::fmadd(y, r, V::set1(8.3334519073e-3f));
+		y = V::fmadd(y, r, V::set1(4.1665795894e-2f));
+		y = V::fmadd(y, r, V::set1(1.6666665459e-1f));
+		y = V::fmadd(y, r, V::set1(5.0000001201e-1f));
+		y = V::fmadd(y, V::mul(r, r), V::add(r, V::set1(1.0f)));
+
+		return V::mul(y, V::pow2n(n));
+	}
+
+	template<typename V>
+	struct Add {
+		static inline typename V::reg vector(typename V::reg a, typename V::reg b) { return V::add(a, b); }
+		static inline float scalar(float a, float b) { return a + b; }
+	};
+
+	template<typename V>
+	struct Sub {
+		static inline typename V::reg vector(typename V::reg a, typename V::reg b) { return V::sub(a, b); }
+		static inline float scalar(float a, float b) { return a - b; }
+	};
+
+	template<typename V>
+	struct Mul {
+		static inline typename V::reg vector(typename V::reg a, typename V::reg b) { return V::mul(a, b); }
+		static inline float scalar(float a, float b) { return a * b; }
+	};
+
+	template<typename V>
+	struct Div {
+		static inline typename V::reg vector(typename V::reg a, typename V::reg b) { return V::div(a, b); }
+		static inline float scalar(float a, float b) { return a / b; }
+	};
+
+	template<typename V>
+	struct Relu {
+		static inline typename V::reg vector(typename V::reg a) { return V::max(a, V::zero()); }
+	};
+
+	template<typename V>
+	struct Exp {
+		static inline typename V::reg vector(typename V::reg a) { return simd::exp<V>(a); }
+	};
+
+	template<typename V>
+	struct Sigmoid {
+		static inline typename V::reg vector(typename V::reg a) {
+			typename V::reg one = V::set1(1.0f);
+			return V::div(one, V::add(one, simd::exp<V>(V::sub(V::zero(), a))));
+		}
+	};
+
+	// tanh(x) = 2 / (1 + exp(-2x)) - 1
+	template<typename V>
+	struct Tanh {
+		static inline typename V::reg vector(typename V::reg a) {
+			typename V::reg one = V::set1(1.0f);
+			typename V::reg e = simd::exp<V>(V::mul(a, V::set1(-2.0f)));
+			return V::sub(V::div(V::set1(2.0f), V::add(one, e)), one);
+		}
+	};
+
+	template<typename V, typename Op>
+	void binary(const float* a, const float* b, float* out, int count) {
+		int i = 0;
+		for (; i + V::width <= count; i += V::width)
+			V::store(out + i, Op::vector(V::load(a + i), V::load(b + i)));
+		for (; i < count; i++)
+			out[i] = Op::scalar(a[i], b[i]);
+	}
+
+	template<typename V, typename Op>
+	void binaryScalar(const float* a, float value, float* out, int count) {
+		typename V::reg broadcast = V::set1(value);
+		int i = 0;
+		for (; i + V::width <= count; i += V::width)
+			V::store(out + i, Op::vector(V::load(a + i), broadcast));
+		for (; i < count; i++)
+			out[i] = Op::scalar(a[i], value);
+	}
+
+	// Tails are computed through a padded register so activations behave the same on all elements
+	template<typename V, typename Op>
+	void unary(const float* a, float* out, int count) {
+		int i = 0;
+		for (; i + V::width <= count; i += V::width)
+			V::store(out + i, Op::vector(V::load(a + i)));
+
+		if (i < count) {
+			float buffer[V::width] = {};
+			for (int j = 0; i + j < count; j++)
+				buffer[j] = a[i + j];
+
+			V::store(buffer, Op::vector(V::load(buffer)));
+
+			for (int j = 0; i + j < count; j++)
+				out[i + j] = buffer[j];
+		}
+	}
+
+	template<typename V>
+	void multiplyAdd(const float* a, const float* b, const float* c, float* out, int count) {
+		int i = 0;
+		for (; i + V::width <= count; i += V::width)
+			V::store(out + i, V::fmadd(V::load(a + i), V::load(b + i), V::load(c + i)));
+		for (; i < count; i++)
+			out[i] = a[i] * b[i] + c[i];
+	}
+
+	template<typename V>
+	void scaleAdd(const float* a, float value, const float* b, float* out, int count) {
+		typename V::reg broadcast = V::set1(value);
+		int i = 0;
+		for (; i + V::width <= count; i += V::width)
+			V::store(out + i, V::fmadd(V::load(a + i), broadcast, V::load(b + i)));
+		for (; i < count; i++)
+			out[i] = a[i] * value + b[i];
+	}
+
+	// Four independent accumulators hide the add latency
+	template<typename V>
+	float sum(const float* a, int count) {
+		typename V::reg acc0 = V::zero(), acc1 = V::zero(), acc2 = V::zero(), acc3 = V::zero();
+		int i = 0;
+		for (; i + 4 * V::width <= count; i += 4 * V::width) {
+			acc0 = V::add(acc0, V::load(a + i));
+			acc1 = V::add(acc1, V::load(a + i + V::width));
+			acc2 = V::add(acc2, V::load(a + i + 2 * V::width));
+			acc3 = V::add(acc3, V::load(a + i + 3 * V::width));
+		}
+		for (; i + V::width <= count; i += V::width)
+			acc0 = V::add(acc0, V::load(a + i));
+
+		float result = V::hsum(V::add(V::add(acc0, acc1), V::add(acc2, acc3)));
+		for (; i < count; i++)
+			result += a[i];
+
+		return result;
+	}
+
+	template<typename V>
+	float dot(const float* a, const float* b, int count) {
+		typename V::reg acc0 = V::zero(), acc1 = V::zero();
+		int i = 0;
+		for (; i + 2 * V::width <= count; i += 2 * V::width) {
+			acc0 = V::fmadd(V::load(a + i), V::load(b + i), acc0);
+			acc1 = V::fmadd(V::load(a + i + V::width), V::load(b + i + V::width), acc1);
+		}
+		for (; i + V::width <= count; i += V::width)
+			acc0 = V::fmadd(V::load(a + i), V::load(b + i), acc0);
+
+		float result = V::hsum(V::add(acc0, acc1));
+		for (; i < count; i++)
+			result += a[i] * b[i];
+
+		return result;
+	}
+
+	template<typename V>
+	float max(const float* a, int count) {
+		if (count == 0)
+			return -3.402823466e+38f;
+
+		typename V::reg acc = V::set1(a[0]);
+		int i = 0;
+		for (; i + V::width <= count; i += V::width)
+			acc = V::max(acc, V::load(a + i));
+
+		float result = V::hmax(acc);
+		for (; i < count; i++)
+			result = a[i] > result ? a[i] : result;
+
+		return result;
+	}
+
+	template<typename V>
+	float min(const float* a, int count) {
+		if (count == 0)
+			return 3.402823466e+38f;
+
+		typename V::reg acc = V::set1(a[0]);
+		int i = 0;
+		for (; i + V::width <= count; i += V::width)
+			acc = V::min(acc, V::load(a + i));
+
+		float result = V::hmin(acc);
+		for (; i < count; i++)
+			result = a[i] < result ? a[i] : result;
+
+		return result;
+	}
+
+	// 4 x (2 * width) block of c stays in registers while the k loop streams rows of b
+	template<typename V>
+	inline void gemmMicroKernel(int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+		typedef typename V::reg reg;
+
+		reg c00 = V::load(c), c01 = V::load(c + V::width);
+		reg c10 = V::load(c + ldc), c11 = V::load(c + ldc + V::width);
+		reg c20 = V::load(c + 2 * ldc), c21 = V::load(c + 2 * ldc + V::width);
+		reg c30 = V::load(c + 3 * ldc), c31 = V::load(c + 3 * ldc + V::width);
+
+		for (int p = 0; p < k; p++) {
+			reg b0 = V::load(b + p * ldb);
+			reg b1 = V::load(b + p * ldb + V::width);
+			reg a0 = V::set1(a[p]);
+			reg a1 = V::set1(a[lda + p]);
+			reg a2 = V::set1(a[2 * lda + p]);
+			reg a3 = V::set1(a[3 * lda + p]);
+
+			c00 = V::fmadd(a0, b0, c00); c01 = V::fmadd(a0, b1, c01);
+			c10 = V::fmadd(a1, b0, c10); c11 = V::fmadd(a1, b1, c11);
+			c20 = V::fmadd(a2, b0, c20); c21 = V::fmadd(a2, b1, c21);
+			c30 = V::fmadd(a3, b0, c30); c31 = V::fmadd(a3, b1, c31);
+		}
+
+		V::store(c, c00); V::store(c + V::width, c01);
+		V::store(c + ldc, c10); V::store(c + ldc + V::width, c11);
+		V::store(c + 2 * ldc, c20); V::store(c + 2 * ldc + V::width, c21);
+		V::store(c + 3 * ldc, c30); V::store(c + 3 * ldc + V::width, c31);
+	}
+
+	template<typename V>
+	void gemm(int m, int n, int k, const float* a, int lda, const float* b, int ldb, float* c, int ldc) {
+		const int rowsBlock = 4;
+		const int columnsBlock = 2 * V::width;
+		// Rows of b used by one pass stay in L2 while all row blocks of a go over them
+		const int depthBlock = 256;
+
+		for (int depth = 0; depth < k; depth += depthBlock) {
+			int kb = k - depth < depthBlock ? k - depth : depthBlock;
+			const float* bPanel = b + depth * ldb;
+			int i = 0;
+
+			for (; i + rowsBlock <= m; i += rowsBlock) {
+				const float* aBlock = a + i * lda + depth;
+				int j = 0;
+
+				for (; j + columnsBlock <= n; j += columnsBlock)
+					gemmMicroKernel<V>(kb, aBlock, lda, bPanel + j, ldb, c + i * ldc + j, ldc);
+
+				for (; j < n; j++) {
+					for (int row = 0; row < rowsBlock; row++) {
+						float acc = 0;
+						for (int p = 0; p < kb; p++)
+							acc += aBlock[row * lda + p] * bPanel[p * ldb + j];
+						c[(i + row) * ldc + j] += acc;
+					}
+				}
+			}
+
+			for (; i < m; i++) {
+				for (int p = 0; p < kb; p++)
+					scaleAdd<V>(bPanel + p * ldb, a[i * lda + depth + p], c + i * ldc, c + i * ldc, n);
+			}
+		}
+	}
+
+	// 4 * width outputs stay in registers while all non-zeros of the row stream their rows of b
+	template<typename V>
+	void sparseRow(const float* values, const int* indices, int nonZeros, const float* b, int ldb, float* c, int n) {
+		typedef typename V::reg reg;
+		int j = 0;
+
+		for (; j + 4 * V::width <= n; j += 4 * V::width) {
+			reg c0 = V::load(c + j), c1 = V::load(c + j + V::width);
+			reg c2 = V::load(c + j + 2 * V::width), c3 = V::load(c + j + 3 * V::width);
+
+			for (int p = 0; p < nonZeros; p++) {
+				const float* bRow = b + indices[p] * ldb + j;
+				reg value = V::set1(values[p]);
+
+				c0 = V::fmadd(value, V::load(bRow), c0);
+				c1 = V::fmadd(value, V::load(bRow + V::width), c1);
+				c2 = V::fmadd(value, V::load(bRow + 2 * V::width), c2);
+				c3 = V::fmadd(value, V::load(bRow + 3 * V::width), c3);
+			}
+
+			V::store(c + j, c0); V::store(c + j + V::width, c1);
+			V::store(c + j + 2 * V::width, c2); V::store(c + j + 3 * V::width, c3);
+		}
+
+		for (; j + V::width <= n; j += V::width) {
+			reg acc = V::load(c + j);
+			for (int p = 0; p < nonZeros; p++)
+				acc = V::fmadd(V::set1(values[p]), V::load(b + indices[p] * ldb + j), acc);
+			V::store(c + j, acc);
+		}
+
+		for (; j < n; j++) {
+			float acc = c[j];
+			for (int p = 0; p < nonZeros; p++)
+				acc += values[p] * b[indices[p] * ldb + j];
+			c[j] = acc;
+		}
+	}
+
+	template<typename V>
+	KernelTable createTable(IsaLevel level) {
+		KernelTable table;
+		table.level = level;
+		table.add = binary<V, Add<V>>;
+		table.sub = binary<V, Sub<V>>;
+		table.mul = binary<V, Mul<V>>;
+		table.div = binary<V, Div<V>>;
+		table.addScalar = binaryScalar<V, Add<V>>;
+		table.subScalar = binaryScalar<V, Sub<V>>;
+		table.mulScalar = binaryScalar<V, Mul<V>>;
+		table.divScalar = binaryScalar<V, Div<V>>;
+		table.multiplyAdd = multiplyAdd<V>;
+		table.scaleAdd = scaleAdd<V>;
+		table.sum = sum<V>;
+		table.max = max<V>;
+		table.min = min<V>;
+		table.dot = dot<V>;
+		table.relu = unary<V, Relu<V>>;
+		table.sigmoid = unary<V, Sigmoid<V>>;
+		table.tanh = unary<V, Tanh<V>>;
+		table.exp = unary<V, Exp<V>>;
+		table.gemm = gemm<V>;
+		table.sparseRow = sparseRow<V>;
+
+		return table;
+	}
+}
@@ -0,0 +1,75 @@
+#include "SimdKernels.h"
+
+const KernelTable& scalarKernels();
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("sse4.2")
+#endif
+
+#include "SimdKernelsImpl.h"
+
+namespace {
+
+	struct Sse42Traits {
+		typedef __m128 reg;
+		static const int width = 4;
+
+		static inline reg load(const float* address) { return _mm_loadu_ps(address); }
+		static inline void store(float* address, reg value) { _mm_storeu_ps(address, value); }
+		static inline reg set1(float value) { return _mm_set1_ps(value); }
+		static inline reg zero() { return _mm_setzero_ps(); }
+		static inline reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+		static inline reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+		static inline reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+		static inline reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+		static inline reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+		static inline reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+		// No FMA before AVX2, the product is rounded separately
+		static inline reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+		static inline reg floor(reg a) { return _mm_floor_ps(a); }
+
+		// 2^n built directly in the exponent bits, n is already clamped to the normal range
+		static inline reg pow2n(reg n) {
+			__m128i exponent = _mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127));
+			return _mm_castsi128_ps(_mm_slli_epi32(exponent, 23));
+		}
+
+		static inline float hsum(reg a) {
+			__m128 pairs = _mm_add_ps(a, _mm_movehl_ps(a, a));
+			return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+
+		static inline float hmax(reg a) {
+			__m128 pairs = _mm_max_ps(a, _mm_movehl_ps(a, a));
+			return _mm_cvtss_f32(_mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+
+		static inline float hmin(reg a) {
+			__m128 pairs = _mm_min_ps(a, _mm_movehl_ps(a, a));
+			return _mm_cvtss_f32(_mm_min_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+	};
+}
+
+const KernelTable& sse42Kernels() {
+	static const KernelTable table = simd::createTable<Sse42Traits>(IsaLevel::SSE42);
+	return table;
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#else
+
+// Never selected on other architectures, CpuFeatures::Detect() reports the scalar level there
+const KernelTable& sse42Kernels() {
+	return scalarKernels();
+}
+
+#endif
@@ -0,0 +1,33 @@
+#include "SimdKernelsImpl.h"
+#include <cmath>
+
+namespace {
+
+	// Single lane fallback, also the reference the vectorized levels are checked against
+	struct ScalarTraits {
+		typedef float reg;
+		static const int width = 1;
+
+		static inline reg load(const float* address) { return *address; }
+		static inline void store(float* address, reg value) { *address = value; }
+		static inline reg set1(float value) { return value; }
+		static inline reg zero() { return 0.0f; }
+		static inline reg add(reg a, reg b) { return a + b; }
+		static inline reg sub(reg a, reg b) { return a - b; }
+		static inline reg mul(reg a, reg b) { return a * b; }
+		static inline reg div(reg a, reg b) { return a / b; }
+		static inline reg max(reg a, reg b) { return a > b ? a : b; }
+		static inline reg min(reg a, reg b) { return a < b ? a : b; }
+		static inline reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+		static inline reg floor(reg a) { return std::floor(a); }
+		static inline reg pow2n(reg n) { return std::ldexp(1.0f, static_cast<int>(n)); }
+		static inline float hsum(reg a) { return a; }
+		static inline float hmax(reg a) { return a; }
+		static inline float hmin(reg a) { return a; }
+	};
+}
+
+const KernelTable& scalarKernels() {
+	static const KernelTable table = simd::createTable<ScalarTraits>(IsaLevel::Scalar);
+	return table;
+}
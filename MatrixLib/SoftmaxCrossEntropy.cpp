@@ -0,0 +1,91 @@
+#include "SoftmaxCrossEntropy.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Elements of the rows processed by one task
+const int minimalTaskElements = 16384;
+
+// Writes the probabilities of one row and returns the log of the sum of exp(logit - max)
+float softmaxRow(const KernelTable& kernels, const float* logits, float max, int classes, float* probabilities) {
+	kernels.subScalar(logits, max, probabilities, classes);
+	kernels.exp(probabilities, probabilities, classes);
+	float sum = kernels.sum(probabilities, classes);
+	kernels.mulScalar(probabilities, 1.0f / sum, probabilities, classes);
+
+	return std::log(sum);
+}
+
+void SoftmaxCrossEntropy::Softmax(const float* logits, int samples, int classes, float* probabilities) {
+	PROFILE_SCOPE("SoftmaxCrossEntropy::Softmax");
+
+	ThreadPool::Instance().ParallelFor(samples, [logits, classes, probabilities](int from, int to) {
+		const KernelTable& kernels = Kernels();
+
+		for (int row = from; row < to; row++) {
+			const float* rowLogits = logits + static_cast<std::size_t>(row) * classes;
+			softmaxRow(kernels, rowLogits, kernels.max(rowLogits, classes), classes, probabilities + static_cast<std::size_t>(row) * classes);
+		}
+	}, std::max(1, minimalTaskElements / std::max(1, classes)));
+}
+
+float SoftmaxCrossEntropy::Forward(const float* logits, const float* targets, int samples, int classes, float* probabilities) {
+	return run(logits, targets, samples, classes, probabilities, false);
+}
+
+void SoftmaxCrossEntropy::Backward(const float* probabilities, const float* targets, int samples, int classes, float* gradient) {
+	Kernels().sub(probabilities, targets, gradient, samples * classes);
+}
+
+float SoftmaxCrossEntropy::ForwardBackward(const float* logits, const float* targets, int samples, int classes, float* gradient) {
+	return run(logits, targets, samples, classes, gradient, true);
+}
+
+// -sum(t * log(p)) = log(sum(exp(z - max))) * sum(t) - sum(t * (z - max)). The shifted logits keep the terms small,
+// so large logits don't cancel, and zero targets are skipped, so masked -inf logits don't give 0 * -inf. The loss
+// is read from the logits before the row of probabilities is written, so the output may alias them. Row losses
+// are summed in the row order, so the result doesn't depend on the threads count
+float SoftmaxCrossEntropy::run(const float* logits, const float* targets, int samples, int classes, float* probabilities, bool gradient) {
+	PROFILE_SCOPE("SoftmaxCrossEntropy");
+
+	if (samples <= 0 || classes <= 0)
+		return 0;
+
+	std::vector<float> losses(samples);
+
+	ThreadPool::Instance().ParallelFor(samples, [&](int from, int to) {
+		const KernelTable& kernels = Kernels();
+		std::vector<float> scratch(probabilities == nullptr ? classes : 0);
+
+		for (int row = from; row < to; row++) {
+			const float* rowLogits = logits + static_cast<std::size_t>(row) * classes;
+			const float* rowTargets = targets + static_cast<std::size_t>(row) * classes;
+			float* rowOut = probabilities == nullptr ? scratch.data() : probabilities + static_cast<std::size_t>(row) * classes;
+
+			float max = kernels.max(rowLogits, classes);
+			float targetsSum = 0;
+			float targetLogits = 0;
+			for (int c = 0; c < classes; c++) {
+				if (rowTargets[c] == 0)
+					continue;
+
+				targetsSum += rowTargets[c];
+				targetLogits += rowTargets[c] * (rowLogits[c] - max);
+			}
+
+			losses[row] = softmaxRow(kernels, rowLogits, max, classes, rowOut) * targetsSum - targetLogits;
+
+			if (gradient)
+				kernels.sub(rowOut, rowTargets, rowOut, classes);
+		}
+	}, std::max(1, minimalTaskElements / classes));
+
+	double total = 0;
+	for (float loss : losses)
+		total += loss;
+
+	return static_cast<float>(total / samples);
+}
\ No newline at end of file
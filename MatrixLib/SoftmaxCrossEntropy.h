@@ -0,0 +1,21 @@
+#pragma once
+#include "Exportable.h"
+
+// Row-wise softmax fused with the cross-entropy loss. Logits, targets, probabilities and gradients are
+// {samples, classes} row-major arrays, targets are one-hot rows (or any rows of probabilities).
+// The row maximum is subtracted before exp and the loss is taken from the log-sum-exp, so large logits
+// neither overflow nor produce log(0), and every row is finished while it is still in cache
+class STORING_ATTR SoftmaxCrossEntropy {
+public:
+	static void Softmax(const float* logits, int samples, int classes, float* probabilities);
+
+	// Mean loss over the samples, probabilities may be nullptr when only the loss is needed
+	static float Forward(const float* logits, const float* targets, int samples, int classes, float* probabilities);
+	// Gradient of every sample's loss with respect to its logits: probabilities - targets
+	static void Backward(const float* probabilities, const float* targets, int samples, int classes, float* gradient);
+	// Forward and backward in one pass over the rows, the gradient may alias the logits
+	static float ForwardBackward(const float* logits, const float* targets, int samples, int classes, float* gradient);
+
+private:
+	static float run(const float* logits, const float* targets, int samples, int classes, float* probabilities, bool gradient);
+};
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "SparseMatrix.h"
+#include "SimdKernels.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+// Measured against the GEMM of the same level on 8 x 784 rows multiplied by 128 outputs, converting the rows
+// included: CSR breaks even at about 0.7 (scalar), 0.4 (SSE4.2), 0.25 (AVX2) and 0.15 (AVX-512). Wider vectors
+// speed the GEMM up more than the gathers of the CSR rows, so the limits fall with the level
+const float maxSparseDensity[] = { 0.5f, 0.3f, 0.2f, 0.1f };
+// Rows multiplied by one task
+const int rowsPerTask = 16;
+// Gradient rows (outputs) accumulated by one task
+const int outputsPerTask = 8;
+
+SparseMatrix::SparseMatrix(int rows, int columns) : rows(rows), columns(columns), rowOffsets(rows + 1, 0) {
+	if (rows < 0 || columns < 0)
+		throw "Sparse matrix sizes must not be negative";
+}
+
+SparseMatrix SparseMatrix::FromDense(const float* data, int rows, int columns) {
+	SparseMatrix matrix(rows, columns);
+
+	for (int row = 0; row < rows; row++) {
+		const float* rowData = data + static_cast<std::size_t>(row) * columns;
+		int nonZeros = 0;
+		for (int column = 0; column < columns; column++)
+			nonZeros += rowData[column] != 0.0f;
+
+		matrix.rowOffsets[row + 1] = matrix.rowOffsets[row] + nonZeros;
+	}
+
+	matrix.columnIndices.resize(matrix.rowOffsets[rows] + 1);
+	matrix.values.resize(matrix.rowOffsets[rows] + 1);
+
+	// Every element is written and the position only moves past non-zeros, so there is no branch to mispredict.
+	// The arrays have one spare element for the write after the last non-zero
+	int* indices = matrix.columnIndices.data();
+	float* values = matrix.values.data();
+	int position = 0;
+
+	for (int row = 0; row < rows; row++) {
+		const float* rowData = data + static_cast<std::size_t>(row) * columns;
+
+		for (int column = 0; column < columns; column++) {
+			indices[position] = column;
+			values[position] = rowData[column];
+			position += rowData[column] != 0.0f;
+		}
+	}
+
+	matrix.columnIndices.pop_back();
+	matrix.values.pop_back();
+	return matrix;
+}
+
+SparseMatrix SparseMatrix::FromCOO(int rows, int columns, const std::vector<int>& rowIndices, const std::vector<int>& columnIndices, const std::vector<float>& values) {
+	if (rowIndices.size() != values.size() || columnIndices.size() != values.size())
+		throw "COO arrays must have the same length";
+
+	std::vector<int> order(values.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	for (std::size_t i = 0; i < values.size(); i++)
+		if (rowIndices[i] < 0 || rowIndices[i] >= rows || columnIndices[i] < 0 || columnIndices[i] >= columns)
+			throw "COO index is out of the matrix";
+
+	std::stable_sort(order.begin(), order.end(), [&rowIndices, &columnIndices](int first, int second) {
+		return rowIndices[first] != rowIndices[second] ? rowIndices[first] < rowIndices[second] : columnIndices[first] < columnIndices[second];
+	});
+
+	SparseMatrix matrix(rows, columns);
+
+	for (std::size_t i = 0; i < order.size(); i++) {
+		int entry = order[i];
+		bool duplicate = i > 0 && rowIndices[order[i - 1]] == rowIndices[entry] && columnIndices[order[i - 1]] == columnIndices[entry];
+
+		if (duplicate) {
+			matrix.values.back() += values[entry];
+		}
+		else {
+			matrix.columnIndices.push_back(columnIndices[entry]);
+			matrix.values.push_back(values[entry]);
+			matrix.rowOffsets[rowIndices[entry] + 1]++;
+		}
+	}
+
+	for (int row = 0; row < rows; row++)
+		matrix.rowOffsets[row + 1] += matrix.rowOffsets[row];
+
+	return matrix;
+}
+
+void SparseMatrix::ToDense(float* out) const {
+	std::memset(out, 0, static_cast<std::size_t>(rows) * columns * sizeof(float));
+
+	for (int row = 0; row < rows; row++)
+		for (int i = rowOffsets[row]; i < rowOffsets[row + 1]; i++)
+			out[static_cast<std::size_t>(row) * columns + columnIndices[i]] = values[i];
+}
+
+void SparseMatrix::ToCOO(std::vector<int>* rowIndices, std::vector<int>* columnIndices, std::vector<float>* values) const {
+	rowIndices->clear();
+	for (int row = 0; row < rows; row++)
+		rowIndices->insert(rowIndices->end(), rowOffsets[row + 1] - rowOffsets[row], row);
+
+	*columnIndices = this->columnIndices;
+	*values = this->values;
+}
+
+float SparseMatrix::Density(const float* data, int count) {
+	if (count <= 0)
+		return 0;
+
+	int nonZeros = 0;
+	for (int i = 0; i < count; i++)
+		nonZeros += data[i] != 0.0f;
+
+	return static_cast<float>(nonZeros) / count;
+}
+
+bool SparseMatrix::ShouldBeSparse(float density) {
+	return density <= maxSparseDensity[static_cast<int>(Kernels().level)];
+}
+
+void SparseMatrix::Multiply(const float* vector, float* out) const {
+	for (int row = 0; row < rows; row++) {
+		float sum = 0;
+		for (int i = rowOffsets[row]; i < rowOffsets[row + 1]; i++)
+			sum += values[i] * vector[columnIndices[i]];
+
+		out[row] = sum;
+	}
+}
+
+// Every non-zero adds a scaled row of the dense matrix to the output row, the rows are independent
+void SparseMatrix::Multiply(const float* dense, int n, int ldDense, float* out, int ldOut) const {
+	PROFILE_SCOPE("SparseMatrix::Multiply");
+
+	ThreadPool::Instance().ParallelFor(rows, [this, dense, n, ldDense, out, ldOut](int from, int to) {
+		MultiplyRows(from, to, dense, n, ldDense, out + static_cast<std::size_t>(from) * ldOut, ldOut);
+	}, rowsPerTask);
+}
+
+void SparseMatrix::MultiplyRows(int from, int to, const float* dense, int n, int ldDense, float* out, int ldOut) const {
+	const KernelTable& kernels = Kernels();
+
+	for (int row = from; row < to; row++) {
+		int first = rowOffsets[row];
+		kernels.sparseRow(values.data() + first, columnIndices.data() + first, rowOffsets[row + 1] - first, dense, ldDense,
+			out + static_cast<std::size_t>(row - from) * ldOut, n);
+	}
+}
+
+// Tasks own disjoint output rows of the gradient, so they don't need to synchronize
+void SparseMatrix::AccumulateWeightGradient(const float* deltas, int outputs, float* gradient) const {
+	PROFILE_SCOPE("SparseMatrix::AccumulateWeightGradient");
+
+	ThreadPool::Instance().ParallelFor(outputs, [this, deltas, outputs, gradient](int from, int to) {
+		for (int row = 0; row < rows; row++) {
+			const float* rowDeltas = deltas + static_cast<std::size_t>(row) * outputs;
+
+			for (int output = from; output < to; output++) {
+				float delta = rowDeltas[output];
+				if (delta == 0.0f)
+					continue;
+
+				float* gradientRow = gradient + static_cast<std::size_t>(output) * columns;
+				for (int i = rowOffsets[row]; i < rowOffsets[row + 1]; i++)
+					gradientRow[columnIndices[i]] += delta * values[i];
+			}
+		}
+	}, outputsPerTask);
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include "Exportable.h"
+#include <vector>
+
+// Row-major {rows, columns} matrix keeping only non-zero values in CSR form: values of row r are
+// [rowOffsets[r], rowOffsets[r + 1]) with their columns in columnIndices. COO triplets are accepted and
+// produced for interchange, the kernels work on CSR
+class STORING_ATTR SparseMatrix {
+	int rows;
+	int columns;
+	std::vector<int> rowOffsets;
+	std::vector<int> columnIndices;
+	std::vector<float> values;
+
+public:
+	SparseMatrix(int rows, int columns);
+
+	static SparseMatrix FromDense(const float* data, int rows, int columns);
+	// Triplets may come in any order, duplicates are summed
+	static SparseMatrix FromCOO(int rows, int columns, const std::vector<int>& rowIndices, const std::vector<int>& columnIndices, const std::vector<float>& values);
+
+	void ToDense(float* out) const;
+	void ToCOO(std::vector<int>* rowIndices, std::vector<int>* columnIndices, std::vector<float>* values) const;
+
+	// Non-zero fraction of a dense array, what the dense/sparse choice is made from
+	static float Density(const float* data, int count);
+	// Below this density converting to CSR and multiplying beats the dense GEMM for a whole layer, the limit depends
+	// on the instruction set level of the active kernels
+	static bool ShouldBeSparse(float density);
+
+	// out[rows] = this * vector[columns]
+	void Multiply(const float* vector, float* out) const;
+	// out[rows x n] += this * dense[columns x n], the cost scales with NonZeros() * n
+	void Multiply(const float* dense, int n, int ldDense, float* out, int ldOut) const;
+	// Same product for rows [from, to) only on the calling thread, out points at the output of row from
+	void MultiplyRows(int from, int to, const float* dense, int n, int ldDense, float* out, int ldOut) const;
+	// gradient[outputs x columns] += deltas^T[outputs x rows] * this, the weight gradient of a fully connected
+	// layer with {outputs, inputs} weights whose input batch is this matrix
+	void AccumulateWeightGradient(const float* deltas, int outputs, float* gradient) const;
+
+	inline int Rows() const { return rows; }
+	inline int Columns() const { return columns; }
+	inline int NonZeros() const { return static_cast<int>(values.size()); }
+	inline float Density() const { return rows * columns == 0 ? 0 : static_cast<float>(values.size()) / (static_cast<float>(rows) * columns); }
+
+	inline const std::vector<int>& RowOffsets() const { return rowOffsets; }
+	inline const std::vector<int>& ColumnIndices() const { return columnIndices; }
+	inline const std::vector<float>& Values() const { return values; }
+};
\ No newline at end of file
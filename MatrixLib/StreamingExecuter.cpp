@@ -0,0 +1,215 @@
+#include "StreamingExecuter.h"
+#include "NativeExecuter.h"
+#include "OpenGLExecuter.h"
+#include "Operations.h"
+#include "Matrix.h"
+#include "Profiler.h"
+#include <algorithm>
+
+const std::size_t streamChunkBytes = 32 << 20;
+
+// Rows [0, rows) of the outermost dimension
+Shape chunkShape(const Shape& shape, int rows) {
+	std::vector<int> dimensions = shape.dimensionSizes;
+	dimensions.front() = rows;
+	return Shape(dimensions);
+}
+
+void checkStreamed(const Operand& expression, const Operand* target, int targetSize) {
+	if (!expression.Elementwise())
+		throw "Only elementwise expressions can be streamed";
+	if (expression.shape.GetDimentionsCount() == 0 || expression.Size() == 0)
+		throw "Streamed expression is empty";
+	if (target->GetData() == nullptr)
+		throw "Streaming can only assign to a matrix";
+	if (target->Size() != targetSize)
+		throw "Target doesn't have the size of the result";
+}
+
+// Values stand first like the target of AssignTo, leaves follow in the order of the kernel parameters
+void evaluateChunk(const Operand& expression, const Matrix& values, Context& context, std::vector<Operand*>& operands) {
+	values.Evaluate(context, operands);
+	expression.Evaluate(context, operands);
+}
+
+// Expression kernel of a chunk, with the vector widths AssignTo starts from
+void generateChunkKernel(const Operand& expression, int rows, bool gpu, StreamKernels* kernels) {
+	Matrix values(expression.shape, nullptr, false);
+	std::vector<Operand*> operands;
+	Context context(gpu ? 4 : 8, gpu);
+
+	context.LimitRows(rows);
+	evaluateChunk(expression, values, context, operands);
+	context.GenerateFile(&kernels->expression);
+	kernels->vectorWidth = context.VectorWidth();
+}
+
+// Partial results of the chunks along axis 0 are combined in the chunk order. ArgMax partials are indices within
+// their chunk, the chunks are compared by their maxima and the first maximum wins like in ReduceOp
+void combineChunks(Reduction reduction, const std::vector<float>& partials, const std::vector<float>& maxima, int chunkRows, int rows, int rowSize, float* out) {
+	int chunks = static_cast<int>(partials.size()) / rowSize;
+
+	for (int i = 0; i < rowSize; i++) {
+		switch (reduction) {
+		case Reduction::Sum:
+		case Reduction::Mean: {
+			double total = 0;
+			for (int chunk = 0; chunk < chunks; chunk++)
+				total += partials[static_cast<std::size_t>(chunk) * rowSize + i];
+
+			out[i] = static_cast<float>(reduction == Reduction::Mean ? total / rows : total);
+			break;
+		}
+		case Reduction::Max:
+		case Reduction::Min:
+			out[i] = partials[i];
+			for (int chunk = 1; chunk < chunks; chunk++) {
+				float partial = partials[static_cast<std::size_t>(chunk) * rowSize + i];
+				out[i] = reduction == Reduction::Max ? std::max(out[i], partial) : std::min(out[i], partial);
+			}
+			break;
+		case Reduction::ArgMax: {
+			float best = maxima[i];
+			out[i] = partials[i];
+			for (int chunk = 1; chunk < chunks; chunk++) {
+				std::size_t position = static_cast<std::size_t>(chunk) * rowSize + i;
+				if (maxima[position] > best) {
+					best = maxima[position];
+					out[i] = partials[position] + static_cast<float>(chunk) * chunkRows;
+				}
+			}
+			break;
+		}
+		}
+	}
+}
+
+StreamingExecuter::StreamingExecuter(Backend backend, int chunkRows) : backend(backend), chunkRows(chunkRows) {
+	if (chunkRows < 0)
+		throw "Chunk rows must not be negative";
+}
+
+int StreamingExecuter::ChunkRows(const Shape& shape) const {
+	int rows = shape.dimensionSizes.front();
+	if (chunkRows > 0)
+		return std::min(chunkRows, rows);
+
+	std::size_t rowBytes = sizeof(float) * (shape.size / rows);
+	return static_cast<int>(std::max<std::size_t>(1, std::min<std::size_t>(rows, streamChunkBytes / rowBytes)));
+}
+
+void StreamingExecuter::Run(const Operand& expression, Operand* target) const {
+	PROFILE_SCOPE("Streaming execution");
+
+	checkStreamed(expression, target, expression.Size());
+
+	// Tiles already evaluate the expression without temporaries of its size
+	if (backend == Backend::Native) {
+		NativeExecuter executer;
+		executer.Run(expression, target);
+		return;
+	}
+
+	bool gpu = backend == Backend::OpenCLGpu;
+	Matrix values(expression.shape, nullptr, false);
+	std::vector<Operand*> operands;
+	Context context;
+	evaluateChunk(expression, values, context, operands);
+
+	OpenGLExecuter executer(gpu);
+	executer.Stream([&expression, gpu](int rows) {
+		StreamKernels kernels;
+		generateChunkKernel(expression, rows, gpu, &kernels);
+		return kernels;
+	}, operands, expression.shape.dimensionSizes.front(), ChunkRows(expression.shape), target->GetData(), nullptr);
+}
+
+void StreamingExecuter::Reduce(const Operand& expression, Reduction reduction, int axis, Operand* target) const {
+	PROFILE_SCOPE("Streaming reduction");
+
+	Shape reducedShape = ReduceOp::ReducedShape(expression.shape, axis, false);
+	checkStreamed(expression, target, reducedShape.size);
+
+	int rows = expression.shape.dimensionSizes.front();
+	int rowSize = expression.Size() / rows;
+	int reducedRowSize = reducedShape.size / rows;
+	int rowsPerChunk = ChunkRows(expression.shape);
+	int chunks = (rows + rowsPerChunk - 1) / rowsPerChunk;
+
+	// Along axis 0 every chunk is reduced into a partial row, Mean is the sum divided at the end and ArgMax
+	// reduces the chunk maxima as well to compare the chunks by
+	std::vector<Reduction> chunkReductions(1, axis == 0 && reduction == Reduction::Mean ? Reduction::Sum : reduction);
+	if (axis == 0 && reduction == Reduction::ArgMax)
+		chunkReductions.push_back(Reduction::Max);
+
+	std::vector<float> partials(axis == 0 ? static_cast<std::size_t>(chunks) * rowSize : 0);
+	std::vector<float> maxima(chunkReductions.size() > 1 ? partials.size() : 0);
+	float* out = target->GetData();
+
+	auto results = [axis, out, rowSize, reducedRowSize, rowsPerChunk, &partials, &maxima](int chunk, int result) {
+		if (axis != 0)
+			return out + static_cast<std::size_t>(chunk) * rowsPerChunk * reducedRowSize;
+
+		return (result == 0 ? partials : maxima).data() + static_cast<std::size_t>(chunk) * rowSize;
+	};
+
+	if (backend == Backend::Native) {
+		const KernelTable& kernels = Kernels();
+		expression.Prepare(kernels);
+
+		Matrix buffer(chunkShape(expression.shape, rowsPerChunk), false);
+		float* data = buffer.data;
+
+		for (int chunk = 0; chunk < chunks; chunk++) {
+			int firstRow = chunk * rowsPerChunk;
+			int rowsCount = std::min(rowsPerChunk, rows - firstRow);
+			int offset = firstRow * rowSize;
+
+			NativeExecuter::ForEachTile(rowsCount * rowSize, [&expression, &kernels, data, offset](int tileOffset, int count) {
+				expression.Compute(kernels, offset + tileOffset, count, data + tileOffset);
+			});
+
+			Shape shape = chunkShape(expression.shape, rowsCount);
+			Matrix values(shape, data, false);
+
+			for (std::size_t r = 0; r < chunkReductions.size(); r++) {
+				ReduceOp reduce(values, chunkReductions[r], axis);
+				Matrix result(reduce.shape, results(chunk, static_cast<int>(r)), false);
+				reduce.AssignTo(&result, Backend::Native);
+			}
+		}
+	}
+	else {
+		bool gpu = backend == Backend::OpenCLGpu;
+		Matrix values(expression.shape, nullptr, false);
+		std::vector<Operand*> operands;
+		Context context;
+		evaluateChunk(expression, values, context, operands);
+
+		OpenGLExecuter executer(gpu);
+		executer.Stream([&expression, &chunkReductions, axis, gpu](int rows) {
+			StreamKernels kernels;
+			generateChunkKernel(expression, rows, gpu, &kernels);
+
+			// Chunk viewed as {outer, axis, inner} like in ReduceOp
+			Shape shape = chunkShape(expression.shape, rows);
+			int outer = 1;
+			int inner = 1;
+			for (int i = 0; i < axis; i++)
+				outer *= shape.dimensionSizes[i];
+			for (int i = axis + 1; i < static_cast<int>(shape.GetDimentionsCount()); i++)
+				inner *= shape.dimensionSizes[i];
+
+			for (Reduction chunkReduction : chunkReductions) {
+				kernels.reductions.push_back(std::string());
+				ReduceOp::GenerateKernel(chunkReduction, outer, shape.dimensionSizes[axis], inner, &kernels.reductions.back());
+				kernels.resultSizes.push_back(outer * inner);
+			}
+
+			return kernels;
+		}, operands, rows, rowsPerChunk, nullptr, results);
+	}
+
+	if (axis == 0)
+		combineChunks(reduction, partials, maxima, rowsPerChunk, rows, rowSize, out);
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#pragma once
+#include "Operand.h"
+#include "Exportable.h"
+
+// Out-of-core evaluation of elementwise expressions over operands larger than the device memory, or than RAM when
+// they are mapped files: the rows of the outermost dimension are evaluated a chunk at a time. The OpenCL backends
+// stream the chunks through two sets of device buffers, so the transfers of a chunk overlap the kernels of the
+// previous one; the native backend computes the chunks with its tiles. Reductions along axis 0 reduce every chunk
+// and combine the partial results at the end, other axes are reduced within the rows of a chunk.
+// Element counts and offsets of the operands are ints, so a streamed tensor has at most 2^31 - 1 floats (8 GB);
+// larger shapes are refused when they are created
+class STORING_ATTR StreamingExecuter {
+	Backend backend;
+	int chunkRows;
+
+public:
+	// chunkRows 0 sizes the chunks to about 32 MB of every operand
+	StreamingExecuter(Backend backend, int chunkRows = 0);
+
+	// Target has the size of the expression and may be mapped from a file as well
+	void Run(const Operand& expression, Operand* target) const;
+	// Target has the size of ReduceOp::ReducedShape of the expression shape and the axis
+	void Reduce(const Operand& expression, Reduction reduction, int axis, Operand* target) const;
+
+	int ChunkRows(const Shape& shape) const;
+};
\ No newline at end of file
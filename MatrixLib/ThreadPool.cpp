@@ -0,0 +1,291 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Each thread gets this many chunks when the grain allows it, so stealing can even out the load
+const int chunksPerThread = 4;
+// Smaller allocations are not worth splitting between the workers
+const std::size_t firstTouchMinimalBytes = 1 << 20;
+
+// Pool and worker index of the current thread, -1 for threads outside the pool
+thread_local ThreadPool* currentPool = nullptr;
+thread_local int currentWorker = -1;
+// Pool of a forked child, it takes the place of the copied one
+ThreadPool* forkedChildPool = nullptr;
+
+// Counts the CPUs of the process affinity (e.g. limited by taskset or given to a data parallel worker)
+void pinCurrentThread(int cpu) {
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << (cpu % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+		return;
+
+	int index = cpu % CPU_COUNT(&allowed);
+	for (int candidate = 0; candidate < CPU_SETSIZE; candidate++) {
+		if (!CPU_ISSET(candidate, &allowed) || index-- > 0)
+			continue;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(candidate, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		return;
+	}
+#endif
+}
+
+ThreadPool& ThreadPool::Instance() {
+	if (forkedChildPool != nullptr)
+		return *forkedChildPool;
+
+	static ThreadPool pool([]() {
+		const char* threads = std::getenv("MATRIXLIB_THREADS");
+		return threads == nullptr ? 0 : std::atoi(threads);
+	}(), []() {
+		const char* pin = std::getenv("MATRIXLIB_PIN_THREADS");
+		return pin != nullptr && std::strcmp(pin, "1") == 0;
+	}());
+
+	return pool;
+}
+
+void ThreadPool::ReplaceInForkedChild(int threadsCount, bool pinThreads) {
+	forkedChildPool = new ThreadPool(threadsCount, pinThreads);
+}
+
+ThreadPool::ThreadPool(int threadsCount, bool pinThreads) : queuedTasks(0), stopping(false), pinThreads(pinThreads) {
+	if (threadsCount <= 0)
+		threadsCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	for (int i = 0; i < threadsCount; i++)
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+
+	// Deques are all created before any worker can try to steal from them
+	for (int i = 0; i < threadsCount; i++)
+		workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+
+	for (auto& worker : workers)
+		worker->thread.join();
+}
+
+int ThreadPool::ThreadsCount() const {
+	return static_cast<int>(workers.size());
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int from, int to)>& function, int minimalGrain) {
+	if (count <= 0)
+		return;
+
+	int threads = ThreadsCount();
+	int grain = std::max(std::max(minimalGrain, 1), (count + threads * chunksPerThread - 1) / (threads * chunksPerThread));
+	int chunks = (count + grain - 1) / grain;
+
+	if (chunks == 1) {
+		function(0, count);
+		return;
+	}
+
+	run(chunks, [&function, grain, count](int chunk) {
+		function(chunk * grain, std::min(count, (chunk + 1) * grain));
+	}, false);
+}
+
+void ThreadPool::ParallelInvoke(const std::vector<std::function<void()>>& functions) {
+	run(static_cast<int>(functions.size()), [&functions](int index) {
+		functions[index]();
+	}, false);
+}
+
+float* ThreadPool::AllocateFirstTouch(std::size_t count) {
+	std::size_t bytes = std::max<std::size_t>(count, 1) * sizeof(float);
+
+	if (bytes < firstTouchMinimalBytes)
+		return static_cast<float*>(std::calloc(count, sizeof(float)));
+
+	float* data = static_cast<float*>(std::malloc(bytes));
+	if (data == nullptr)
+		throw "Can't allocate memory";
+
+	// Static partition: worker i writes block i, which is the block a top level ParallelFor gives it first
+	int threads = ThreadsCount();
+	run(threads, [data, count, threads](int block) {
+		std::size_t from = count * block / threads;
+		std::size_t to = count * (block + 1) / threads;
+		std::memset(data + from, 0, (to - from) * sizeof(float));
+	}, true);
+
+	return data;
+}
+
+void ThreadPool::workerLoop(int index) {
+	currentPool = this;
+	currentWorker = index;
+
+	if (pinThreads)
+		pinCurrentThread(index);
+
+	Worker& worker = *workers[index];
+
+	while (true) {
+		Task task;
+		if (takeTask(index, &task)) {
+			execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wakeUp.wait(lock, [this, &worker]() {
+			if (stopping || queuedTasks.load() > 0)
+				return true;
+
+			std::lock_guard<std::mutex> workerLock(worker.mutex);
+			return !worker.pinnedTasks.empty();
+		});
+
+		if (stopping)
+			return;
+	}
+}
+
+void ThreadPool::push(int worker, Task task, bool pinned) {
+	// Counted before it is visible, so the counter never drops below the number of queued tasks
+	if (!pinned)
+		queuedTasks++;
+
+	{
+		std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+		if (pinned)
+			workers[worker]->pinnedTasks.push_back(std::move(task));
+		else
+			workers[worker]->tasks.push_back(std::move(task));
+	}
+
+	// Taking the lock orders the push with a worker that is checking the wake up condition
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+
+	if (pinned)
+		wakeUp.notify_all();
+	else
+		wakeUp.notify_one();
+}
+
+// Own pinned tasks, then own tasks from the back (the most recently split, still in cache), then other workers from the front
+bool ThreadPool::takeTask(int worker, Task* taskOut) {
+	int count = ThreadsCount();
+
+	if (worker >= 0) {
+		Worker& own = *workers[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+
+		if (!own.pinnedTasks.empty()) {
+			*taskOut = std::move(own.pinnedTasks.front());
+			own.pinnedTasks.pop_front();
+			return true;
+		}
+
+		if (!own.tasks.empty()) {
+			*taskOut = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			queuedTasks--;
+			return true;
+		}
+	}
+
+	if (queuedTasks.load() == 0)
+		return false;
+
+	for (int i = 1; i <= count; i++) {
+		Worker& victim = *workers[(worker + i + count) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		if (!victim.tasks.empty()) {
+			*taskOut = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			queuedTasks--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::execute(Task& task) {
+	TaskGroup& group = *task.group;
+
+	try {
+		task.function();
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(group.mutex);
+		if (!group.error)
+			group.error = std::current_exception();
+	}
+
+	// The waiting thread may destroy the group as soon as pending reaches zero
+	std::lock_guard<std::mutex> lock(group.mutex);
+	if (--group.pending == 0)
+		group.done.notify_all();
+}
+
+// Workers help with any queued task while waiting, other threads sleep so they don't take the workers' blocks
+void ThreadPool::wait(TaskGroup& group) {
+	if (currentPool == this) {
+		while (group.pending.load() > 0) {
+			Task task;
+			if (takeTask(currentWorker, &task))
+				execute(task);
+			else
+				std::this_thread::yield();
+		}
+	}
+	else {
+		std::unique_lock<std::mutex> lock(group.mutex);
+		group.done.wait(lock, [&group]() { return group.pending.load() == 0; });
+	}
+
+	// Last execute still holds the group mutex after it decrements pending
+	std::lock_guard<std::mutex> lock(group.mutex);
+	if (group.error)
+		std::rethrow_exception(group.error);
+}
+
+void ThreadPool::run(int count, const std::function<void(int index)>& function, bool pinned) {
+	if (count <= 0)
+		return;
+
+	TaskGroup group;
+	group.pending = count;
+
+	bool nested = currentPool == this;
+	int threads = ThreadsCount();
+
+	// Nested calls keep the work on the calling worker and let the others steal it, the last index is pushed
+	// first so the worker takes them in order. Top level calls give every worker a contiguous block
+	for (int i = count - 1; i >= 0; i--) {
+		int worker = nested && !pinned ? currentWorker : static_cast<int>(static_cast<long long>(i) * threads / count);
+		push(worker, Task{ [&function, i]() { function(i); }, &group }, pinned);
+	}
+
+	wait(group);
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+#include "Exportable.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler shared by all parallel code of the library.
+// Every worker owns a deque: it takes its own tasks from the back and idle workers steal from the front.
+// A worker waiting for nested tasks keeps running queued tasks instead of blocking, so nested parallel
+// loops never start more threads than the pool has
+class STORING_ATTR ThreadPool {
+	struct TaskGroup {
+		std::atomic<int> pending;
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr error;
+	};
+
+	struct Task {
+		std::function<void()> function;
+		TaskGroup* group;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		// Tasks which must run on this worker (first touch), they are never stolen
+		std::deque<Task> pinnedTasks;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<int> queuedTasks;
+	std::mutex sleepMutex;
+	std::condition_variable wakeUp;
+	bool stopping;
+	bool pinThreads;
+
+public:
+	// Pool used by the library, MATRIXLIB_THREADS sets its size and MATRIXLIB_PIN_THREADS=1 pins its workers
+	static ThreadPool& Instance();
+	// A forked child gets a copy of the pool without its threads, so it replaces the pool before using the library.
+	// The copy is abandoned, the child has to end with _exit so its destructor doesn't wait for the missing threads
+	static void ReplaceInForkedChild(int threadsCount, bool pinThreads);
+
+	// threadsCount <= 0 uses all hardware threads, pinned worker i runs only on the i-th CPU the process may use
+	ThreadPool(int threadsCount = 0, bool pinThreads = false);
+	~ThreadPool();
+
+	int ThreadsCount() const;
+
+	// Calls function(from, to) on chunks covering [0, count) and returns when all of them are done.
+	// Chunk size follows count so every thread gets a few chunks to balance, but never goes below minimalGrain.
+	// Top level calls split the range into contiguous blocks per worker, the same way AllocateFirstTouch does.
+	// The first exception thrown by the chunks is rethrown here
+	void ParallelFor(int count, const std::function<void(int from, int to)>& function, int minimalGrain = 1);
+	// Runs independent functions (e.g. pipeline stages or graph nodes) and waits for all of them
+	void ParallelInvoke(const std::vector<std::function<void()>>& functions);
+
+	// Zeroed memory for count floats whose pages are first written by the workers that will process them,
+	// so on NUMA systems they are placed on the node of those workers. Must be released with std::free
+	float* AllocateFirstTouch(std::size_t count);
+
+private:
+	void workerLoop(int index);
+	void push(int worker, Task task, bool pinned);
+	bool takeTask(int worker, Task* taskOut);
+	void execute(Task& task);
+	void wait(TaskGroup& group);
+	void run(int count, const std::function<void(int index)>& function, bool pinned);
+};
\ No newline at end of file